@@ -180,4 +180,5 @@ ftruncate
 sml_stat
 sml_fstat
 sml_lstat
+sml_regionstats
 
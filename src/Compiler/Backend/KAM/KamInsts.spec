@@ -170,3 +170,14 @@ PRIM_IS_NULL                0
 GET_CONTEXT                 0
 
 CHECK_LINKAGE               1
+
+SELECT_STACK_SELECT         2
+SELECT_ENV_SELECT           2
+IF_NOT_EQUAL_JMP_REL        1
+IF_NOT_LESS_THAN_JMP_REL    1
+IF_NOT_LESS_EQUAL_JMP_REL   1
+IF_NOT_GREATER_THAN_JMP_REL 1
+IF_NOT_GREATER_EQUAL_JMP_REL 1
+
+PRIM_CINT_TO_I              0
+PRIM_STRING_TO_CSTRING      0
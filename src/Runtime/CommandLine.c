@@ -15,19 +15,35 @@
 
 int commandline_argc;     // Kam-backend (Interp.c) needs access to update these variables
 char **commandline_argv;  // when discharging object file arguments.
-static int app_arg_index = 1; /* index for first argument to application. Set by parseArgs */
+int app_arg_index = 1;    /* index for first argument to application. Set by parseArgs */
 // static char exeName[100];
 
 /*----------------------------------------*
  * Flags recognized by the runtime system *
  *----------------------------------------*/
+long region_arena_mb = REGION_ARENA_MB;
+long region_keep_pages = REGION_KEEP_PAGES;
+long region_prefault = 0;
+long region_stats = 0;
+long region_page_stat = 0;   // 0: no page reuse statistics; n>0: sample 1 in n pages
+#ifdef THREADS
+long region_numa_nodes = 0;   // 0: no NUMA pools; -1: the nodes of the machine; n>0: n simulated nodes
+#endif
 #ifdef ENABLE_GC
 long disable_gc = 0;
 long verbose_gc = 0;
 long report_gc = 0;
 double heap_to_live_ratio = HEAP_TO_LIVE_RATIO;
+long gc_threads = 1;          // number of threads scanning and copying during GC
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+long gc_mark_region = 0;      // 0: copy all region pages; p>0: keep pages with at least p% live words
+#endif
+double gc_target_overhead = 0.0; // 0.0: fixed heap_to_live_ratio; p>0.0: aim at p% of the time in GC
+long max_heap_kb = 0;         // 0: no limit; n>0: keep heap_to_live_ratio times live data below n kb
+char *gc_log = NULL;          // file for an event per GC (JSON lines, or CSV if named *.csv)
 #ifdef ENABLE_GEN_GC
 long only_major_gc = 0;
+long gc_max_pause_us = 0;     // 0: no pause budget; n>0: aim at minor collections of at most n us
 #endif
 #endif
 
@@ -35,11 +51,20 @@ void
 printUsage(void) 
 {
   fprintf(stderr,"Usage: %s\n", commandline_argv[0]);
-  fprintf(stderr,"      [-help, -h] \n");
+  fprintf(stderr,"      [-help, -h] [-region_arena n] [-region_keep n] [-region_prefault] \n");
+  fprintf(stderr,"      [-region_stats] [-region_page_stat n] \n");
+#ifdef THREADS
+  fprintf(stderr,"      [-region_numa | -region_numa_sim n] \n");
+#endif
 #ifdef ENABLE_GC
   fprintf(stderr,"      [-disable_gc | -verbose_gc | -report_gc] [-heap_to_live_ratio d] \n");
-#ifdef ENABLE_GENGC
-  fprintf(stderr,"      [-only_major_gc] \n");
+  fprintf(stderr,"      [-gc_threads n] [-gc_log file] \n");
+  fprintf(stderr,"      [-gc_target_overhead p] [-max_heap n] \n");
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  fprintf(stderr,"      [-gc_mark_region p] \n");
+#endif
+#ifdef ENABLE_GEN_GC
+  fprintf(stderr,"      [-only_major_gc] [-gc_max_pause_us n] \n");
 #endif // ENABLE_GEN_GC
 #endif /*ENABLE_GC*/
 #ifdef PROFILING
@@ -50,13 +75,52 @@ printUsage(void)
 #endif /*PROFILING*/
   fprintf(stderr,"  where\n");
   fprintf(stderr,"      -help, -h                Print this help screen and exit.\n\n");
+  fprintf(stderr,"      -region_arena n          Reserve region pages in ranges of n Mb\n");
+  fprintf(stderr,"                                  (default: %ld); 0 means use malloc.\n", region_arena_mb);
+  fprintf(stderr,"      -region_keep n           Keep at most about n free region pages\n");
+  fprintf(stderr,"                                  before returning pages to the OS\n");
+  fprintf(stderr,"                                  (default: %ld).\n", region_keep_pages);
+  fprintf(stderr,"      -region_prefault         Touch the memory of new region pages\n");
+  fprintf(stderr,"                                  when it is obtained from the OS.\n");
+  fprintf(stderr,"      -region_stats            Print region statistics when the\n");
+  fprintf(stderr,"                                  program terminates.\n");
+  fprintf(stderr,"      -region_page_stat n      Collect region page reuse statistics\n");
+  fprintf(stderr,"                                  for 1 in n pages and print them\n");
+  fprintf(stderr,"                                  when the program terminates.\n");
+#ifdef THREADS
+  fprintf(stderr,"      -region_numa             Keep free region pages in a pool for\n");
+  fprintf(stderr,"                                  each NUMA node.\n");
+  fprintf(stderr,"      -region_numa_sim n       As -region_numa, but with n simulated\n");
+  fprintf(stderr,"                                  nodes (at most %d).\n", REGION_NUMA_MAX_NODES);
+#endif
+  fprintf(stderr,"\n");
 #ifdef ENABLE_GC
   fprintf(stderr,"      -disable_gc              Disable garbage collector.\n");
   fprintf(stderr,"      -verbose_gc              Show info after each garbage collection.\n");
   fprintf(stderr,"      -report_gc               Show info when program terminates.\n");
   fprintf(stderr,"      -heap_to_live_ratio d    Use heap to live ratio d (default: %f).\n", heap_to_live_ratio);
+  fprintf(stderr,"      -gc_threads n            Copy live values with n threads during\n");
+  fprintf(stderr,"                                  garbage collection (default: %ld, at\n", gc_threads);
+  fprintf(stderr,"                                  most %d).\n", GC_MAX_THREADS);
+  fprintf(stderr,"      -gc_log file             Write an event for each garbage collection\n");
+  fprintf(stderr,"                                  to file, as JSON lines or, if the file\n");
+  fprintf(stderr,"                                  name ends in .csv, as CSV.\n");
+  fprintf(stderr,"      -gc_target_overhead p    Adjust the heap to live ratio after each\n");
+  fprintf(stderr,"                                  garbage collection, aiming at spending\n");
+  fprintf(stderr,"                                  p%% of the time in GC (e.g., 5%%).\n");
+  fprintf(stderr,"      -max_heap n              Lower the heap to live ratio if needed to\n");
+  fprintf(stderr,"                                  keep the heap below n Mb (or n bytes\n");
+  fprintf(stderr,"                                  with suffix K, M or G; e.g., 2G).\n");
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  fprintf(stderr,"      -gc_mark_region p        Mark live values before copying and keep\n");
+  fprintf(stderr,"                                  region pages with at least p%% live\n");
+  fprintf(stderr,"                                  words in place (not with -gc_threads).\n");
+#endif
 #ifdef ENABLE_GEN_GC
   fprintf(stderr,"      -only_major_gc           Use only major collections.\n");
+  fprintf(stderr,"      -gc_max_pause_us n       Collect the young generation often enough\n");
+  fprintf(stderr,"                                  for minor collections to take at most\n");
+  fprintf(stderr,"                                  about n microseconds.\n");
 #endif // ENABLE_GEN_GC
   fprintf(stderr, "\n");
 #endif /*ENABLE_GC*/
@@ -87,27 +151,102 @@ printUsage(void)
 void 
 parseCmdLineArgs(int argc, char *argv[]) 
 {
-
-#if ( PROFILING || ENABLE_GC )
   long match;
-#endif
 
   /* initialize global variables to hold command line arguments */
   commandline_argc = argc;
   commandline_argv = argv;
 
-#if ( PROFILING || ENABLE_GC )
   //  strcpy(exeName, (char *)argv[0]);
   match = 1;
   while ((--argc > 0) && match) {
     ++argv;    /* next parameter. */
     match = 0;
 
+#if ( PROFILING || ENABLE_GC )
     if ((strcmp((char *)argv[0], "-h")==0) ||
 	(strcmp((char *)argv[0], "-help")==0)) {
       match = 1;
       printUsage();  /* exits */
     }
+#endif /* PROFILING || ENABLE_GC */
+
+    if (strcmp((char *)argv[0],"-region_arena")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a number. */
+	region_arena_mb = atol((char *)argv[0]);
+	if ( region_arena_mb < 0 ) {
+	  fprintf(stderr,"Something wrong with the number n in switch -region_arena n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No number after the switch -region_arena.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-region_keep")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a number. */
+	region_keep_pages = atol((char *)argv[0]);
+	if ( region_keep_pages < 0 ) {
+	  fprintf(stderr,"Something wrong with the number n in switch -region_keep n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No number after the switch -region_keep.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-region_prefault")==0) {
+      region_prefault = 1;
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-region_stats")==0) {
+      region_stats = 1;
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-region_page_stat")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a number. */
+	region_page_stat = atol((char *)argv[0]);
+	if ( region_page_stat < 1 ) {
+	  fprintf(stderr,"Something wrong with the number n in switch -region_page_stat n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No number after the switch -region_page_stat.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+
+#ifdef THREADS
+    if (strcmp((char *)argv[0],"-region_numa")==0) {
+      region_numa_nodes = -1;
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-region_numa_sim")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a number. */
+	region_numa_nodes = atol((char *)argv[0]);
+	if ( region_numa_nodes < 1 || region_numa_nodes > REGION_NUMA_MAX_NODES ) {
+	  fprintf(stderr,"Something wrong with the number n in switch -region_numa_sim n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No number after the switch -region_numa_sim.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+#endif /* THREADS */
 
 #ifdef ENABLE_GC
     if (strcmp((char *)argv[0],"-disable_gc")==0) {
@@ -130,6 +269,21 @@ parseCmdLineArgs(int argc, char *argv[])
       only_major_gc = 1;
       match = 1;
     }
+
+    if (strcmp((char *)argv[0],"-gc_max_pause_us")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a number. */
+	gc_max_pause_us = atol((char *)argv[0]);
+	if ( gc_max_pause_us < 1 ) {
+	  fprintf(stderr,"Something wrong with the number n in switch -gc_max_pause_us n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No number after the switch -gc_max_pause_us.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
 #endif // ENABLE_GEN_GC
 
     if (strcmp((char *)argv[0],"-heap_to_live_ratio")==0) {
@@ -145,6 +299,86 @@ parseCmdLineArgs(int argc, char *argv[])
       app_arg_index++; /* this is an two-word option */
       match = 1;
     }
+
+    if (strcmp((char *)argv[0],"-gc_threads")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a number. */
+	gc_threads = atol((char *)argv[0]);
+	if ( gc_threads < 1 || gc_threads > GC_MAX_THREADS ) {
+	  fprintf(stderr,"Something wrong with the number n in switch -gc_threads n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No number after the switch -gc_threads.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-gc_target_overhead")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a percentage. */
+	gc_target_overhead = atof((char *)argv[0]);   // a trailing % is ignored
+	if ( gc_target_overhead <= 0.0 || gc_target_overhead >= 100.0 ) {
+	  fprintf(stderr,"Something wrong with the percentage p in switch -gc_target_overhead p.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No percentage after the switch -gc_target_overhead.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+
+    if (strcmp((char *)argv[0],"-max_heap")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a size. */
+	char *unit;
+	double n = strtod((char *)argv[0], &unit);
+	switch ( *unit ) {
+	case 'k': case 'K': max_heap_kb = (long)n; break;
+	case 'm': case 'M': case '\0': max_heap_kb = (long)(n * 1024.0); break;
+	case 'g': case 'G': max_heap_kb = (long)(n * 1024.0 * 1024.0); break;
+	default: max_heap_kb = 0;
+	}
+	if ( max_heap_kb < 1 ) {
+	  fprintf(stderr,"Something wrong with the size n in switch -max_heap n.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No size after the switch -max_heap.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+    if (strcmp((char *)argv[0],"-gc_mark_region")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a percentage. */
+	gc_mark_region = atol((char *)argv[0]);
+	if ( gc_mark_region < 1 || gc_mark_region > 100 ) {
+	  fprintf(stderr,"Something wrong with the percentage p in switch -gc_mark_region p.\n");
+	  printUsage();
+	}
+      } else {
+	fprintf(stderr,"No percentage after the switch -gc_mark_region.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
+#endif
+
+    if (strcmp((char *)argv[0],"-gc_log")==0) {
+      if (--argc > 0 && (*++argv)[0]) { /* Is there a file name. */
+	gc_log = (char *)argv[0];
+      } else {
+	fprintf(stderr,"No file name after the switch -gc_log.\n");
+	printUsage();
+      }
+      app_arg_index++; /* this is an two-word option */
+      match = 1;
+    }
 #endif /*ENABLE_GC*/
 #ifdef PROFILING
     if (strcmp((char *)argv[0],"-notimer")==0) {
@@ -252,7 +486,6 @@ parseCmdLineArgs(int argc, char *argv[])
       app_arg_index++;
     }
   }
-#endif /* PROFILING || ENABLE_GC */  
 
   return;
 }
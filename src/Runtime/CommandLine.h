@@ -29,13 +29,29 @@ the first commandline argument for the application is -arg1 because
 /*----------------------------------------*
  * Flags recognized by the runtime system *
  *----------------------------------------*/
+extern long region_arena_mb;
+extern long region_keep_pages;
+extern long region_prefault;
+extern long region_stats;
+extern long region_page_stat;
+#ifdef THREADS
+extern long region_numa_nodes;
+#endif
 extern long disable_gc;
 extern long verbose_gc;
 extern long report_gc;
 #ifdef ENABLE_GEN_GC
 extern long only_major_gc;
+extern long gc_max_pause_us;
 #endif
 extern double heap_to_live_ratio;
+extern long gc_threads;
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+extern long gc_mark_region;
+#endif
+extern double gc_target_overhead;
+extern long max_heap_kb;
+extern char *gc_log;
 
 /*----------------------------------------*
  * Prototypes                             *
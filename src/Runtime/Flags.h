@@ -31,9 +31,93 @@
    polymorphic equality is disabled boxed representation must be
    used. */
 
-#define REGION_PAGE_BAG_SIZE 30
+/* Region pages are obtained from the operating system in chunks of
+   REGION_PAGE_BAG_SIZE pages. Chunks are returned to the operating
+   system as a whole (see trim_freelist in Region.c), so the size of a
+   chunk should be a multiple of the size of an OS page. */
+#define REGION_PAGE_BAG_SIZE 32
+
+/* When THREADS is defined, each thread caches free region pages in a
+   magazine in front of the global freelist. Pages are moved between a
+   magazine and the freelist REGION_PAGE_MAGAZINE_BATCH pages at a
+   time, and a magazine holds at most REGION_PAGE_MAGAZINE_SIZE pages. */
+#define REGION_PAGE_MAGAZINE_BATCH 32
+#define REGION_PAGE_MAGAZINE_SIZE (4*REGION_PAGE_MAGAZINE_BATCH)
+
+/* When THREADS is defined, free region pages may be kept in a pool for
+   each NUMA node (see -region_numa); at most REGION_NUMA_MAX_NODES
+   pools are used. */
+#define REGION_NUMA_MAX_NODES 8
+
+/* Default size (in Mb) of the virtual ranges that region pages are
+   carved from; see callSbrk in Region.c. A value of 0 makes the
+   runtime system use malloc for region pages instead. */
+#define REGION_ARENA_MB 256
+
+/* Default number of free region pages kept by the runtime system
+   when idle pages are returned to the operating system, and the
+   minimal number of pages inserted in the freelist between attempts. */
+#define REGION_KEEP_PAGES 4096
+#define REGION_TRIM_INTERVAL 1024
+
+/* Region page reuse statistics (see -region_page_stat) are kept for
+   at most REGION_PAGE_STAT_SIZE sampled pages (a power of two). The
+   report counts a reuse as warm if fewer than REGION_PAGE_STAT_WARM
+   bytes of region pages were handed out since the page was last
+   handed out. */
+#define REGION_PAGE_STAT_SIZE 65536
+#define REGION_PAGE_STAT_WARM (1024*1024)
+
+/* Default size (in Mb) of the arena in which SMLserver shares loaded
+   leaf bytecode among its child processes (see SharedCode.h and the
+   SmlCodeCacheSize directive); 0 disables the arena. The arena holds
+   at most SHARED_CODE_ENTRIES bytecode files. A bytecode file that
+   was changed less than SHARED_CODE_MIN_AGE seconds ago is not shared,
+   because a file system with coarse time stamps may give it the same
+   time stamps when it is replaced again. */
+#define SHARED_CODE_MB 64
+#define SHARED_CODE_ENTRIES 4096
+#define SHARED_CODE_MIN_AGE 2
+
 #define HEAP_TO_LIVE_RATIO 3.0
 
+/* With -gc_target_overhead p or -max_heap n, the heap to live ratio
+   is adjusted after each garbage collection, but is kept between
+   GC_MIN_HEAP_TO_LIVE_RATIO and GC_MAX_HEAP_TO_LIVE_RATIO. */
+#define GC_MIN_HEAP_TO_LIVE_RATIO 1.25
+#define GC_MAX_HEAP_TO_LIVE_RATIO 50.0
+
+/* With -gc_threads n, the garbage collector copies live values with
+   n threads (at most GC_MAX_THREADS). The thread scanning a
+   generation hands out the complete region pages between its scan
+   pointer and the allocation pointer to the other threads, in
+   segments of at most GC_SCAN_SEGMENT pages. */
+#define GC_MAX_THREADS 64
+#define GC_SCAN_SEGMENT 8
+
+/* When scanning a record or a table, the garbage collector prefetches
+   the value that a field points at GC_PREFETCH_DISTANCE fields before
+   evacuating it; 0 disables prefetching. */
+#define GC_PREFETCH_DISTANCE 4
+
+/* The values of string regions (regions allocated with
+   allocateStringRegion) contain no pointers and are left in place by
+   the garbage collector, except in every GC_STRING_REGION_PERIOD'th
+   collection, which copies them, so that dead strings in long-lived
+   string regions are reclaimed; 1 copies them in every collection. */
+#define GC_STRING_REGION_PERIOD 8
+
+/* With -gc_max_pause_us n and generational GC, the young generations
+   are collected after at least GC_MIN_YOUNG_PAGES region pages have
+   been allocated, however short the pause budget. */
+#define GC_MIN_YOUNG_PAGES 64
+
+/* When the KAM interpreter is compiled with KAM_PROFILE_PAIRS, it
+   counts how often each instruction is executed directly after each
+   other instruction and writes the counts to KAM_PROFILE_PAIRS_FILE
+   at exit (see Interp.c). */
+#define KAM_PROFILE_PAIRS_FILE "kam_pairs.txt"
+
 #ifdef DEBUG
 #define debug(Arg) Arg
 #else
@@ -11,8 +11,12 @@
 #include <stdlib.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "Flags.h"
 #include "Tagging.h"
@@ -61,13 +65,58 @@ ssize_t raised_exn_interupt = 0;          // set to 1 if signal occurred during
 ssize_t raised_exn_overflow = 0;          // set to 1 if signal occurred during GC
 
 ssize_t time_gc_all_ms = 0;               // total time of GC (in milliseconds)
+size_t gc_trigger = GC_TRIGGER_HEAP;      // why time_to_gc was set; see GC.h
+
+static FILE *gc_log_file = NULL;          // the -gc_log file, opened at the first GC
+static int gc_log_csv = 0;                // 1 if the -gc_log file name ends in .csv
+static unsigned long long *gc_pauses = NULL; // pause of each GC (in ns), for report_gc_pauses
+static size_t gc_pauses_size = 0;
+static long scan_sp_max = 0;              // scan stack high-water mark of the current GC
+
+static double adapt_ratio = 0.0;          // heap to live ratio wanted by -gc_target_overhead
+static double adapt_gc_ns = 0.0;          // decaying sums of GC time and of total time
+static double adapt_all_ns = 0.0;         //   since the end of the previous GC
+static unsigned long long adapt_last_end_ns = 0;
 
 #ifdef ENABLE_GEN_GC
 ssize_t major_p = 0;                      // flag to specify whether gc should be major or minor
 #define is_major_p (major_p == 1)
 #define is_minor_p (major_p == 0)
+size_t rp_young = 0;                      // region pages allocated since the last GC
+size_t rp_young_limit = 0;                // with -gc_max_pause_us, GC when rp_young exceeds
+                                          //   rp_young_limit (0: no limit yet)
+
+// In a minor collection, values are copied to an old generation only
+// from its last page before the collection and on; mk_from_space
+// saves the last page of g1 for each region, in the order of the
+// region stack.
+static Rp **g1_last_pages = NULL;
+static size_t g1_last_pages_size = 0;
 #endif // ENABLE_GEN_GC
 
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+// With -gc_mark_region p, the live values in each region page are
+// recorded in a side bitmap before the collection (see mr_mark).
+#define MR_BITMAP_WORDS ((ALLOCATABLE_WORDS_IN_REGION_PAGE+31)/32)
+
+typedef struct {
+  Rp *rp;                          // NULL: the entry is empty
+  Gen *gen;                        // the generation of the page
+  size_t live;                     // live words in the page
+  uint32_t bits[MR_BITMAP_WORDS];  // the first words of the live values
+} MrPage;
+
+static MrPage *mr_pages = NULL;    // hash table of pages with live values
+static size_t mr_size = 0;         // number of entries (a power of two)
+static size_t mr_kept = 0;         // pages kept in place by the current GC
+static Gen gc_kept_gen;            // the gen of kept pages during the GC
+
+// The pages of string regions are left in place, except in every
+// GC_STRING_REGION_PERIOD'th collection (see allocateStringRegion)
+static int gc_strings_kept = 0;    // string regions are kept in the current GC
+#define is_kept_string_gen(gen) (gc_strings_kept && is_stringregion(gen))
+#endif
+
 // This implementation assumes a down growing stack (e.g., X86)
 #define NUM_REGS 8
 
@@ -98,6 +147,7 @@ ssize_t major_p = 0;                      // flag to specify whether gc should b
   ReturnLabel: */
 
 Rp *from_space_begin, *from_space_end;
+size_t from_space_pages;   // number of pages in from-space
 
 #ifdef ENABLE_GEN_GC
 //#define debug_gc(x) (x)
@@ -110,13 +160,13 @@ Rp *from_space_begin, *from_space_end;
 /* PRETTY PRINTING */
 /*******************/
 static void 
-pw(char *s,unsigned int tag) 
+pw(char *s,uintptr_t tag) 
 {
   int idx;
   
-  printf("%s(%x) is ",s,tag);
-  for (idx=0;idx<32;idx++) {
-    if (tag & 0x80000000)
+  printf("%s(%" PRIxPTR ") is ",s,tag);
+  for (idx=0;idx<8*(int)sizeof(uintptr_t);idx++) {
+    if (tag & ((uintptr_t)1 << (8*sizeof(uintptr_t)-1)))
       printf("1");
     else
       printf("0");
@@ -161,15 +211,20 @@ print(uintptr_t *value)
   return;
 }
 
-// #define copy_words(from,to,w) (memcpy((to),(from),4*(w)))
-
+// Most values are small; they are copied with word moves, whereas
+// larger values are copied with memcpy, which uses the widest moves
+// available on the machine.
 inline static void 
 copy_words(uintptr_t *from,uintptr_t *to,size_t num) 
 {
-  size_t i;
-  for ( i = 0 ; i < num ; i++ ) 
-    *(to + i) = *(from + i);
-  return;
+  switch ( num ) {
+  case 4: to[3] = from[3];
+  case 3: to[2] = from[2];
+  case 2: to[1] = from[1];
+  case 1: to[0] = from[0];
+  case 0: return;
+  default: memcpy(to, from, num * sizeof(uintptr_t));
+  }
 }
 
 /*******************************/
@@ -193,6 +248,7 @@ init_scan_stack()
       size_scan_stack = INIT_STACK_SIZE_W;
     }
   scan_sp = 0;
+  scan_sp_max = 0;
   return;
 }
 
@@ -203,6 +259,8 @@ push_scan_stack(uintptr_t *ptr)
 {
   scan_stack[scan_sp] = ptr;
   scan_sp++;
+  if ( scan_sp > scan_sp_max )
+    scan_sp_max = scan_sp;
   if ( scan_sp >= size_scan_stack ) 
     {
       size_scan_stack *= 2;
@@ -266,7 +324,7 @@ push_scan_container(uintptr_t *ptr)
   if (container_alloc >= size_scan_container) 
     {
       size_scan_container *= 2;
-      scan_container = (uintptr_t **) realloc((void *)scan_container, size_scan_container*4);
+      scan_container = (uintptr_t **) realloc((void *)scan_container, size_scan_container*(sizeof(void *)));
       if (scan_container == NULL)
 	{
 	  die("GC.push_scan_container: Unable to increase scan_container");
@@ -313,12 +371,65 @@ void pp_from_space()
 
 // We mark all region pages such that we can distinguish them from
 // to-space region pages by setting a bit in the next n pointer.
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+// Move the pages of gen that are not kept in place to from-space and
+// return the kept pages, linked in their original order.
+static void
+mr_split_gen(Gen *gen, Rp **kept_first, Rp **kept_last)
+{
+  Rp *rp, *next, *last = ((Rp *)gen->b) - 1;
+  Rp *from_first = NULL, *from_last = NULL;
+  uintptr_t *i;
+
+  for ( rp = clear_fp(gen->fp) ; rp ; rp = next )
+    {
+      next = rp->n;
+      if ( rp->gen == &gc_kept_gen )
+	{
+	  if ( rp == last )           // terminate the values as in allocGenSlow
+	    for ( i = gen->a ; i < gen->b ; i++ )  *i = notPP;
+	  if ( *kept_first )
+	    (*kept_last)->n = rp;
+	  else
+	    *kept_first = rp;
+	  *kept_last = rp;
+	}
+      else
+	{
+	  if ( from_first )
+	    from_last->n = rp;
+	  else
+	    from_first = rp;
+	  from_last = rp;
+	}
+    }
+  if ( from_first )
+    {
+      from_last->n = from_space_begin;
+      if ( from_space_begin == NULL )
+	from_space_end = from_last;
+      from_space_begin = from_first;
+    }
+}
+#endif
+
 static inline void
 mk_from_space_gen(Gen *gen) 
 {
-  // Move region pages to from-space
-  (((Rp *)gen->b)-1)->n = from_space_begin;
-  from_space_begin = clear_fp(gen->fp);
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  Rp *kept_first = NULL, *kept_last = NULL;
+
+  if ( mr_kept )
+    mr_split_gen(gen, &kept_first, &kept_last);
+  else
+#endif
+    {
+      // Move region pages to from-space
+      (((Rp *)gen->b)-1)->n = from_space_begin;
+      if ( from_space_begin == NULL )
+	from_space_end = ((Rp *)gen->b)-1;
+      from_space_begin = clear_fp(gen->fp);
+    }
 
   // Allocate new region page
   {
@@ -332,11 +443,27 @@ mk_from_space_gen(Gen *gen)
       gen->fp = NULL;
   }
   alloc_new_block(gen);
+
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  // Kept pages come before the new page, so that values are copied
+  // only to pages allocated during the collection
+  if ( kept_first )
+    {
+      int rt = all_marks_fp(*gen);
+      kept_last->n = clear_fp(gen->fp);
+      gen->fp = kept_first;
+      set_fp(*gen,rt);
+    }
+#endif
 }
 
 static void mk_from_space() 
 {
   Ro *r;
+  extern long rp_total;
+#ifdef ENABLE_GEN_GC
+  size_t n = 0;
+#endif // ENABLE_GEN_GC
 
 #ifdef PROFILING
   int j;
@@ -345,8 +472,32 @@ static void mk_from_space()
   from_space_begin = NULL;
   from_space_end = (((Rp *)TOP_REGION->g0.b)-1); // Points at last region page
 
+  // In a major collection, every region page in use is moved to
+  // from-space, so the pages need not be counted; in a minor
+  // collection, the pages of the young generations are counted below.
+  from_space_pages = rp_total - size_free_list();
+#ifdef ENABLE_GEN_GC
+  if ( is_minor_p )
+    from_space_pages = 0;
+#elif !defined(PROFILING)
+  if ( mr_kept )
+    {
+      from_space_pages -= mr_kept;     // see mr_split_gen
+      from_space_end = NULL;
+    }
+  if ( gc_strings_kept )
+    from_space_end = NULL;             // see mk_from_space_gen
+#endif // ENABLE_GEN_GC
+
   for( r = TOP_REGION ; r ; r = r->p ) 
     {
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+      if ( is_kept_string_gen(r->g0) )
+	{
+	  from_space_pages -= NoOfPagesInGen(&(r->g0));
+	  continue;
+	}
+#endif
      #ifdef PROFILING
       // Similar to resetRegion in Region.c
      #ifdef ENABLE_GEN_GC
@@ -379,6 +530,20 @@ static void mk_from_space()
       #endif // ENABLE_GEN_GC
     #endif // PROFILING
 
+#ifdef ENABLE_GEN_GC
+    if ( is_minor_p )
+      {
+	from_space_pages += NoOfPagesInGen(&(r->g0));
+	if ( n == g1_last_pages_size )
+	  {
+	    g1_last_pages_size = 2 * g1_last_pages_size + 256;
+	    g1_last_pages = (Rp **)realloc(g1_last_pages, g1_last_pages_size * sizeof(Rp *));
+	    if ( g1_last_pages == NULL )
+	      die("mk_from_space: unable to save the last pages of old generations");
+	  }
+	g1_last_pages[n++] = ((Rp *)(r->g1.b)) - 1;
+      }
+#endif // ENABLE_GEN_GC
     mk_from_space_gen(&(r->g0));
 #ifdef ENABLE_GEN_GC
     if ( is_major_p ) 
@@ -397,10 +562,37 @@ points_into_dataspace (uintptr_t *p) {
 #define is_integer(obj_ptr)         ((obj_ptr) & 1)
 #define is_forward_ptr(x)           (((x) & 0x03) == 0)  /* Bit 0 and 1 must be zero */
 #define clear_forward_ptr(x)        (x)
-#define tag_forward_ptr(x)          ((unsigned long)(x))
+#define tag_forward_ptr(x)          ((uintptr_t)(x))
+
+// Region pages are of size REGION_PAGE_SIZE and aligned
+#define get_rp_header(x)            ((Rp *)(((uintptr_t)(x)) & ~REGION_PAGE_MASK))
+
+// Prefetch the value that the field value x points at, together with
+// the descriptor of its region page, both of which are inspected when
+// x is evacuated. Prefetching an address that is not mapped (e.g., the
+// page of a stack-allocated value) is harmless.
+#if defined(__GNUC__) && GC_PREFETCH_DISTANCE > 0
+#define gc_prefetch(x) ({ uintptr_t __x = (x);                            \
+                          if ( ! is_integer(__x) ) {                       \
+                            __builtin_prefetch((void *)__x, 1);            \
+                            __builtin_prefetch(get_rp_header(__x), 0); } })
+#else
+#define gc_prefetch(x) ({})
+#endif
 
-// Region pages are of size 1Kb and aligned
-#define get_rp_header(x)            ((Rp *)(((unsigned long)(x)) & 0xFFFFFC00))  
+// Prefetch for the first fields of the n fields from s; the remaining
+// fields are prefetched GC_PREFETCH_DISTANCE fields ahead by the loop
+// evacuating them.
+inline static void
+gc_prefetch_fields(uintptr_t *s, size_t n)
+{
+#if GC_PREFETCH_DISTANCE > 0
+  if ( n > GC_PREFETCH_DISTANCE )
+    n = GC_PREFETCH_DISTANCE;
+  while ( n-- )
+    gc_prefetch(*s++);
+#endif
+}
 
 size_t 
 size_lobj (size_t tag)
@@ -459,7 +651,7 @@ next_untagged_value(uintptr_t* s, uintptr_t* a) {
  * Find allocated bytes in generations/regions; for measurements
  * -------------------------------------------------------------- */
 
-static int 
+static size_t 
 allocated_bytes_in_gen(Gen *gen) 
 {
   uintptr_t *s;  // scan pointer
@@ -505,7 +697,7 @@ allocated_bytes_in_gen(Gen *gen)
     case TAG_CON1: 
     case TAG_REF: {
       s += 2;
-      allocated_bytes += 8;
+      allocated_bytes += 2 * (sizeof(void *));
       break;
     }
     default: {
@@ -530,7 +722,7 @@ allocated_bytes_in_gen(Gen *gen)
 
 // Assumes that region does not contain untagged pairs or 
 // untagged refs
-static int 
+static size_t 
 allocated_bytes_in_region(Region r) 
 {
   return allocated_bytes_in_gen(&(r->g0))
@@ -540,24 +732,24 @@ allocated_bytes_in_region(Region r)
     ;
 }
 
-static inline int
-allocated_bytes_in_gen_untagged(Gen *gen, int obj_sz)  // obj_sz is in words
+static inline size_t
+allocated_bytes_in_gen_untagged(Gen *gen, size_t obj_sz)  // obj_sz is in words
 {
   Rp* rp;
-  int n = 0;
+  size_t n = 0;
   for ( rp = clear_fp(gen->fp) ; rp ; rp = clear_tospace_bit(rp->n) )
     {
       if ( clear_tospace_bit(rp->n) )
 	// Take care of alignment
-	n += 4 * obj_sz * (ALLOCATABLE_WORDS_IN_REGION_PAGE / obj_sz);  // not last page
+	n += (sizeof(void *)) * obj_sz * (ALLOCATABLE_WORDS_IN_REGION_PAGE / obj_sz);  // not last page
       else
-	n += 4 * ((gen->a) - (rp->i));  // last page
+	n += (sizeof(void *)) * ((gen->a) - (rp->i));  // last page
     }
   return n;
 }
 
-static int
-allocated_bytes_in_region_untagged(Ro* r, int obj_sz)   // obj_sz is in words
+static size_t
+allocated_bytes_in_region_untagged(Ro* r, size_t obj_sz)   // obj_sz is in words
 {
   return allocated_bytes_in_gen_untagged(&(r->g0),obj_sz)
     #ifdef ENABLE_GEN_GC
@@ -566,10 +758,10 @@ allocated_bytes_in_region_untagged(Ro* r, int obj_sz)   // obj_sz is in words
     ;
 }
 
-static int 
+static size_t 
 allocated_bytes_in_regions(void) 
 {
-  int n = 0;
+  size_t n = 0;
   Ro* r;
   for ( r = TOP_REGION ; r ; r = r->p )
     {
@@ -590,17 +782,17 @@ allocated_bytes_in_regions(void)
   return n;
 }
 
-static int 
+static size_t 
 allocated_bytes_in_lobjs(void) 
 {
-  int n = 0;
+  size_t n = 0;
   Ro* r;
   Lobjs *lobjs;
 
   for ( r = TOP_REGION ; r ; r = r->p )
     for ( lobjs = r->lobjs ; lobjs ; lobjs = clear_lobj_bit(lobjs->next) ) 
       {
-	unsigned int tag;
+	uintptr_t tag;
        #ifdef PROFILING
 	tag = *(&(lobjs->value) + sizeObjectDesc);
        #else
@@ -614,10 +806,10 @@ allocated_bytes_in_lobjs(void)
 
 // Find the number of allocated pages in a region/generation
 
-static int 
+static size_t 
 allocated_pages_in_gen(Gen *gen) 
 {
-  int n = 0;
+  size_t n = 0;
   Rp *rp;
   
   // Maybe the generation-bit is set
@@ -626,7 +818,7 @@ allocated_pages_in_gen(Gen *gen)
   return n;
 }
 
-static int 
+static size_t 
 allocated_pages_in_region(Region r) 
 {
   return allocated_pages_in_gen(&(r->g0))
@@ -636,10 +828,10 @@ allocated_pages_in_region(Region r)
     ;
 }
 
-static int 
+static size_t 
 allocated_pages_in_regions(void) 
 {
-  int n = 0;
+  size_t n = 0;
   Ro* r;
   for ( r = TOP_REGION ; r ; r = r->p )
     {
@@ -964,6 +1156,10 @@ evacuate(uintptr_t obj)
 
   // Object is in an infinite region
   gen = rp->gen; 
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  if ( gen == &gc_kept_gen || is_kept_string_gen(*gen) )  // the page is kept in place
+    return obj;
+#endif
 #ifdef ENABLE_GEN_GC
   if (is_minor_p && is_gen_1(*gen))  // old generation
     { 
@@ -1049,8 +1245,13 @@ evacuate(uintptr_t obj)
   return (uintptr_t)new_obj_ptr;
 }
 
-static uintptr_t*
-scan_tagged_value(uintptr_t *s)      // s is the scan pointer
+// The scan of a tagged value is shared between the sequential and the
+// parallel collector (see do_scan_stack_par), which differ only in
+// the function used to evacuate the fields of the value.
+typedef uintptr_t (*Evacuator)(uintptr_t);
+
+static inline __attribute__((always_inline)) uintptr_t*
+scan_tagged_value_with(uintptr_t *s, Evacuator evacuate)      // s is the scan pointer
 {
   // All large objects and objects in finite regions are temporarily 
   // annotated as immovable. We therefore use val_tag_kind and not 
@@ -1068,8 +1269,11 @@ scan_tagged_value(uintptr_t *s)      // s is the scan pointer
     Table table = (Table)s;
     sz = get_table_size(table->size);
     s++;
+    gc_prefetch_fields(s, sz);
     while ( sz )
       {
+	if ( sz > GC_PREFETCH_DISTANCE )
+	  gc_prefetch(*(s+GC_PREFETCH_DISTANCE));
 	*s = evacuate(*s);
 	s++;
 	sz--;
@@ -1082,8 +1286,11 @@ scan_tagged_value(uintptr_t *s)      // s is the scan pointer
     num_to_skip = get_record_skip(*s);
     s = s + 1 + num_to_skip;
     remaining = sz - num_to_skip;
+    gc_prefetch_fields(s, remaining);
     while ( remaining ) 
       {
+	if ( remaining > GC_PREFETCH_DISTANCE )
+	  gc_prefetch(*(s+GC_PREFETCH_DISTANCE));
 	*s = evacuate(*s);
 	s++;
 	remaining--;
@@ -1107,6 +1314,12 @@ scan_tagged_value(uintptr_t *s)      // s is the scan pointer
   }
 }  
 
+static uintptr_t*
+scan_tagged_value(uintptr_t *s)
+{
+  return scan_tagged_value_with(s, evacuate);
+}
+
 static void 
 do_scan_stack() 
 {
@@ -1142,6 +1355,7 @@ do_scan_stack()
 		  #if PROFILING
 		   s += sizeObjectDesc;
 		  #endif
+		   gc_prefetch(*(s+2));
 		   *(s+1) = evacuate(*(s+1));
 		   *(s+2) = evacuate(*(s+2));
 		   s = next_untagged_value(s+2,gen->a);
@@ -1167,6 +1381,8 @@ do_scan_stack()
                   #if PROFILING
 		  s += sizeObjectDesc;
                   #endif
+		  gc_prefetch(*(s+2));
+		  gc_prefetch(*(s+3));
 		  *(s+1) = evacuate(*(s+1));
 		  *(s+2) = evacuate(*(s+2));
 		  *(s+3) = evacuate(*(s+3));
@@ -1198,234 +1414,1416 @@ do_scan_stack()
   return;
 }
 
-inline static void 
-clear_tospace_bit_and_set_colorPtr_in_gen(Gen *gen) 
-{ Rp *p;
+#ifndef PROFILING
+/*************************************************************/
+/* PARALLEL SCAN AND COPY                                    */
+/*                                                           */
+/* With -gc_threads n (n > 1), the roots are evacuated by    */
+/* the main thread, after which n threads (the main thread   */
+/* and n-1 worker threads, created at the first collection)  */
+/* take over the work of do_scan_stack. Each thread has its  */
+/* own stack of work, from which the other threads steal     */
+/* when they run out of work. An item of work is either a    */
+/* value marked immovable (the scan container), the rest of  */
+/* a generation starting at a scan pointer (the scan stack), */
+/* or a segment of complete region pages of a generation.    */
+/*                                                           */
+/* A value is copied by the thread that first replaces its   */
+/* descriptor (or, for untagged values, its first component) */
+/* with GC_BUSY using compare-and-swap; other threads wait   */
+/* until the copy has been made and the forward pointer      */
+/* installed. Allocation in a generation, and the scan       */
+/* status of the generation, are protected by a lock         */
+/* associated with the generation. As in the sequential      */
+/* collector, at most one thread scans the last page of a    */
+/* generation; it hands out the complete pages between its  */
+/* scan pointer and the allocation pointer to the other      */
+/* threads. The parallel mode is not available when          */
+/* profiling.                                                */
+/*************************************************************/
+
+#if defined(__i386__) || defined(__x86_64__)
+#define gc_relax() __asm__ __volatile__ ("pause")
+#else
+#define gc_relax() ({})
+#endif
 
-  for ( p = clear_fp(gen->fp) ; p ; p = p->n ) 
-    {
-      // Clear tospace-bit - in minor gc, pages in g1 are not marked!
-#ifdef CHECK_GC
-      if ( ! is_tospace_bit(p->n) 
-#ifdef ENABLE_GEN_GC
-	   && ( is_major_p || ! is_gen_1(*gen) ) 
-#endif // ENABLE_GEN_GC
-	   )
-	die ("gc: page in tospace not marked in major gc");
-#endif // CHECK_GC
-      p->n = clear_tospace_bit(p->n);
+static inline void
+gc_lock(volatile int *l)
+{
+  while ( __sync_lock_test_and_set(l, 1) )
+    while ( *l )
+      gc_relax();
+}
 
-#ifdef ENABLE_GEN_GC
-      // Update colorPtr
-      if ( p->n ) // tospace-bit has been cleared
-	p->colorPtr = (uintptr_t *) (p+1); // Not last page so entire page is black
-      else
-	p->colorPtr = gen->a; // Last page so only allocated part of page is black
-#endif // ENABLE_GEN_GC
+#define gc_unlock(l) (__sync_lock_release(l))
+
+// Locks protecting allocation in, and the scan status of,
+// generations; a generation is mapped to a lock by its address.
+#define GC_GEN_LOCKS 256
+static struct { volatile int l; char pad[60]; } gc_gen_locks[GC_GEN_LOCKS];
+#define gc_gen_lock(gen) (&(gc_gen_locks[(((uintptr_t)(gen)) >> 3) % GC_GEN_LOCKS].l))
+
+// Serialises getting new region pages; FREELISTMUTEX is a no-op in
+// runtime systems with garbage collection.
+static volatile int gc_page_lock = 0;
+
+// Replaces the descriptor (or the first component) of a value while
+// the value is being copied; the address is word aligned and is not
+// the address of a value, so it is neither a tag nor a forward
+// pointer into to-space.
+static uintptr_t gc_busy_cell;
+#define GC_BUSY ((uintptr_t)(&gc_busy_cell))
+
+#define GC_WORK_CONTAINER 0    // s is a value marked immovable
+#define GC_WORK_GEN       1    // s is a scan pointer in a generation
+#define GC_WORK_SEGMENT   2    // the pages from rp up to (not including) stop
+
+typedef struct {
+  long kind;
+  uintptr_t *s;
+  Rp *rp;
+  Rp *stop;
+} GcWork;
+
+typedef struct {
+  volatile int lock;           // protects the work stack
+  GcWork *work;                // the owner pushes and pops at top;
+  size_t bot, top, size;       //   other threads steal at bot
+  uintptr_t **container;       // values marked immovable by this thread
+  size_t container_n, container_size;
+  size_t copied;               // words copied by this thread
+  size_t steals;               // items of work stolen by this thread
+  size_t top_max;              // high-water mark of the work stack
+  pthread_t thread;
+  char pad[64];
+} GcWorker;
+
+static GcWorker gc_workers[GC_MAX_THREADS];
+static __thread GcWorker *gc_self = NULL;  // the worker of the current thread
+
+static long gc_par_n = 0;                  // number of threads in the current collection
+static volatile long gc_par_idle = 0;      // number of threads without work
+
+static pthread_mutex_t gc_par_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_par_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gc_par_done = PTHREAD_COND_INITIALIZER;
+static long gc_par_round = 0;              // incremented to start the worker threads
+static long gc_par_running = 0;            // worker threads not done with the round
+static long gc_par_created = 0;            // number of worker threads created
+
+static void
+gc_push_work(GcWorker *w, long kind, uintptr_t *s, Rp *rp, Rp *stop)
+{
+  gc_lock(&w->lock);
+  if ( w->top >= w->size )
+    {
+      w->size = w->size ? 2 * w->size : INIT_STACK_SIZE_W;
+      w->work = (GcWork *) realloc((void *)w->work, w->size * sizeof(GcWork));
+      if ( w->work == NULL )
+	{
+	  die("GC.gc_push_work: Unable to increase work stack");
+	}
     }
+  w->work[w->top].kind = kind;
+  w->work[w->top].s = s;
+  w->work[w->top].rp = rp;
+  w->work[w->top].stop = stop;
+  w->top++;
+  if ( w->top - w->bot > w->top_max )
+    w->top_max = w->top - w->bot;
+  gc_unlock(&w->lock);
 }
 
-#define predSPDef(sp,n) ((sp)+=(n))
-#define succSPDef(sp) (sp--)
+static int
+gc_pop_work(GcWorker *w, GcWork *item)
+{
+  int found = 0;
+  gc_lock(&w->lock);
+  if ( w->top > w->bot )
+    {
+      *item = w->work[--(w->top)];
+      if ( w->top == w->bot )
+	w->top = w->bot = 0;
+      found = 1;
+    }
+  gc_unlock(&w->lock);
+  return found;
+}
 
-#ifdef CHECK_GC
-void
-check_all_lobjs(void)    // used for debugging
+static int
+gc_steal_work(GcWorker *w, GcWork *item)
 {
-  Region r;
-  //printf("[check_all_lobjs begin]\n");
-  for( r = TOP_REGION ; r ; r = r->p ) 
+  long i;
+  for ( i = 1 ; i < gc_par_n ; i++ )
     {
-      Lobjs *lobjs;
-      for ( lobjs = r->lobjs ; lobjs ; lobjs = clear_lobj_bit(lobjs->next) )
+      GcWorker *v = &gc_workers[((w - gc_workers) + i) % gc_par_n];
+      if ( v->top == v->bot )
+	continue;
+      gc_lock(&v->lock);
+      if ( v->top > v->bot )
 	{
-	  uintptr_t* tag_ptr;
-	  //uintptr_t sz;
-#ifdef PROFILING
-	  tag_ptr = &(*(&(lobjs->value) + sizeObjectDesc));
-#else
-	  tag_ptr = &(lobjs->value);
-#endif
-	  //sz = size_lobj(*tag_ptr);
-	  //printf("  size_lobj: %d\n", sz);
-	  if ( is_const(*tag_ptr) )
-	    die ("check_lobjs: lobj constant bit set");
-	  if ( !is_lobj_bit(lobjs->next) )
-	    die ("check_lobjs: lobj bit not set"); 
+	  *item = v->work[(v->bot)++];
+	  if ( v->top == v->bot )
+	    v->top = v->bot = 0;
+	  gc_unlock(&v->lock);
+	  w->steals++;
+	  return 1;
 	}
+      gc_unlock(&v->lock);
     }
-  //printf("[check_all_lobjs end]\n");
+  return 0;
 }
-#endif // CHECK_GC
 
-double
-region_utilize(long pages, long bytes)
+static int
+gc_work_available(void)
 {
-  if ( pages > 0.0 )
-    return (100.0 * (double)bytes 
-	    / ((double)(pages * 4 * ALLOCATABLE_WORDS_IN_REGION_PAGE)));
-  else 
-    return 0.0;
+  long i;
+  for ( i = 0 ; i < gc_par_n ; i++ )
+    if ( gc_workers[i].top != gc_workers[i].bot )
+      return 1;
+  return 0;
 }
- 
-void 
-gc(uintptr_t **sp, size_t reg_map) 
+
+// Set the immovable-bit of a stack-allocated value or a large
+// object and push the value on the scan container, unless another
+// thread did so first.
+static void
+gc_par_mark_immovable(uintptr_t *obj_ptr)
 {
-  long time_gc_one_ms = 0;
-  extern Rp* freelist;
-  uintptr_t **sp_ptr;
-  uintptr_t *fd_ptr;
-  unsigned long fd_size, fd_offset_to_return;
-  uintptr_t *w_ptr;
-  long w_idx;
-  unsigned long w;
-  long offset;
-  uintptr_t *value_ptr;
-  long num_d_labs;
-  long size_rcf, size_ccf, size_spilled_region_args;
-  extern long rp_used;
-  extern long rp_total;
-  struct rusage rusage_begin;
-  struct rusage rusage_end;
-  unsigned long bytes_from_space = 0;
-  unsigned long pages_from_space = 0;
-  unsigned long alloc_period_save = 0;
-  Ro *r;
+  GcWorker *w = gc_self;
+  uintptr_t v;
 
-  // Mutex on the garbage collector; used by alloc_new_block in
-  // Region.c for determining whether the tospace-bit should be set on
-  // new allocated pages.
-  doing_gc = 1; 
+  do {
+    v = *(volatile uintptr_t *)obj_ptr;
+    if ( is_const(v) )
+      return;
+  } while ( ! __sync_bool_compare_and_swap(obj_ptr, v, set_tag_const(v)) );
 
-#ifdef ENABLE_GEN_GC
-  // See code below after GC proper
-  //  major_p = (major_p==0)?(1):(0);
-  //  major_p = 0;
-  if ( only_major_gc )
-    major_p = 1;
-#endif
+  if ( w->container_n >= w->container_size )
+    {
+      w->container_size = w->container_size ? 2 * w->container_size : INIT_CONTAINER_SIZE_W;
+      w->container = (uintptr_t **) realloc((void *)w->container, w->container_size * sizeof(uintptr_t *));
+      if ( w->container == NULL )
+	{
+	  die("GC.gc_par_mark_immovable: Unable to increase scan container");
+	}
+    }
+  w->container[(w->container_n)++] = obj_ptr;
+  gc_push_work(w, GC_WORK_CONTAINER, obj_ptr, NULL, NULL);
+}
 
-  stack_top_gc = (uintptr_t *)sp;
+// Allocate n words in gen during parallel collection; the caller
+// holds the lock of gen.
+static inline uintptr_t *
+gc_par_alloc(Gen *gen, size_t n)
+{
+  uintptr_t *t = gen->a;
+  uintptr_t *i;
 
-#ifdef CHECK_GC
-  if ((ssize_t)(stack_bot_gc - stack_top_gc) < 0)
+  if ( (size_t)(gen->b - t) < n )
     {
-      die("gc: stack_top_gc larger than stack_bot_gc on down-growing stack");
+      for ( i = t ; i < gen->b ; i++ )  *i = notPP;
+      gc_lock(&gc_page_lock);
+      alloc_new_block(gen);
+      gc_unlock(&gc_page_lock);
+      t = gen->a;
     }
-#endif // CHECK_GC
+  gen->a = t + n;
+  return t;
+}
 
-  num_gc++;
+static uintptr_t
+evacuate_par(uintptr_t obj)
+{
+  Rp* rp;
+  Gen* gen;
+  Gen* copy_to_gen;
+  volatile int *lock;
+  uintptr_t *obj_ptr, *new_obj_ptr;
+  uintptr_t v;
+  ssize_t size;
+  long untagged, push;
 
-  if ( verbose_gc || report_gc )
+  if (is_integer(obj))
     {
-      getrusage(RUSAGE_SELF, &rusage_begin);
-#ifdef ENABLE_GEN_GC
-      if ( major_p )
-	num_gc_major++;
-#endif // ENABLE_GEN_GC
+      return obj;                         // not subject to GC
     }
 
-  if ( verbose_gc ) 
+  obj_ptr = (uintptr_t *)obj;          // object is a pointer
+
+  if ( points_into_dataspace(obj_ptr) )
     {
-      fprintf(stderr,"[%s#%zd",
-#ifdef ENABLE_GEN_GC	      
-	      (is_major_p)?("GC"):("gc"),
-#else
-	      "GC",
-#endif
-	      num_gc);
-      fflush(stderr);
-      bytes_from_space = allocated_bytes_in_regions();
-      pages_from_space = allocated_pages_in_regions();
-      lobjs_beforegc = allocated_bytes_in_lobjs();
-      alloc_period_save = alloc_period;
-      alloc_period = 0;
+      return obj;                         // not subject to GC
     }
 
-  // Initialize the scan stack (for Infinite Regions) and the
-  // container (for Finite Regions and large objects)
-  init_scan_stack();
-  init_scan_container();
+  if ( is_stack_allocated(obj_ptr) )
+    {                                     // object immovable
+      gc_par_mark_immovable(obj_ptr);
+      return obj;
+    }
+
+  rp = get_rp_header(obj_ptr);
+
+  if ( is_lobj_bit(rp->n) )
+    {                                     // object immovable
+      gc_par_mark_immovable(obj_ptr);
+      return obj;
+    }
 
+  // Object is in an infinite region
+  gen = rp->gen;
 #ifdef ENABLE_GEN_GC
-#ifdef CHECK_GC
-  chk_no_tospacebits_regions();
+  if (is_minor_p && is_gen_1(*gen))  // old generation
+    {
+      return obj;
+    }
+#else
+  if ( is_kept_string_gen(*gen) )    // the region is kept in place
+    return obj;
+#endif // ENABLE_GEN_GC
+  switch ( rtype(*gen) ) {
+  case RTYPE_PAIR:   size = 2; break;
+  case RTYPE_REF:    size = 1; break;
+  case RTYPE_TRIPLE: size = 3; break;
+  default:           size = 0; break;
+  }
+  untagged = (size != 0);
 
-  for ( r = TOP_REGION ; r ; r = r->p )
+  if ( untagged )
     {
-      Rp* rp;
-      for ( rp = clear_fp(r->g1.fp) ; rp ; rp = clear_tospace_bit(rp->n) )
+      // Untagged; obj_ptr points at slot before the actual value and
+      // the forward pointer is installed in the first component
+      for (;;)
 	{
-	  if ( clear_tospace_bit(rp->n) )
+	  v = *(volatile uintptr_t *)(obj_ptr+1);
+	  if ( v == GC_BUSY )
 	    {
-	      if ( rp->colorPtr != (uintptr_t *)(rp+1) )
-		{
-		  pp_gen(&(r->g1));
-		  printf("r->g1.b=%p\n", r->g1.b);
-		  die ("problem with middle page");	
-		}
+	      gc_relax();
+	      continue;
 	    }
-	  else 
-	    // last page
-	    if ( rp->colorPtr != (uintptr_t *)(r->g1.a) )
-	      {
-		printf("rp->colorPtr=%p - r->g1.a=%p\n", rp->colorPtr, r->g1.a);
-		pp_gen(&(r->g1));
-		die ("problem with final page");
+	  if ( points_into_tospace(v) )
+	    return v;
+	  if ( __sync_bool_compare_and_swap(obj_ptr+1, v, GC_BUSY) )
+	    break;
+	}
+      copy_to_gen = target_gen(gen, rp, obj_ptr+1);
+      lock = gc_gen_lock(copy_to_gen);
+      gc_lock(lock);
+      new_obj_ptr = gc_par_alloc(copy_to_gen, size) - 1;
+      *(new_obj_ptr+1) = v;
+      copy_words(obj_ptr+2, new_obj_ptr+2, size-1);
+    }
+  else
+    {
+      // Tagged; the forward pointer is installed in the descriptor
+      for (;;)
+	{
+	  v = *(volatile uintptr_t *)obj_ptr;
+	  if ( v == GC_BUSY )
+	    {
+	      gc_relax();
+	      continue;
+	    }
+	  if ( is_forward_ptr(v) )
+	    {
+#ifdef CHECK_GC
+	      if ( ! points_into_tospace(v) )
+		{
+		  printf("*obj_ptr=0x%zx - obj_ptr=%p - rp=%p - gen=%p - rtype(*gen)=%zx\n", v, obj_ptr, rp, gen, rtype(*gen));
+		  die ("forward ptr check failed\n");
+		}
+#endif // CHECK_GC
+	      return clear_forward_ptr(v);
+	    }
+	  if ( __sync_bool_compare_and_swap(obj_ptr, v, GC_BUSY) )
+	    break;
+	}
+      size = get_size_obj(&v);      // only the descriptor is inspected
+#ifdef CHECK_GC
+      if ( size > ALLOCATABLE_WORDS_IN_REGION_PAGE )
+	die ("evacuate_par: object too large");
+#endif // CHECK_GC
+      copy_to_gen = target_gen(gen, rp, obj_ptr);
+      lock = gc_gen_lock(copy_to_gen);
+      gc_lock(lock);
+      new_obj_ptr = gc_par_alloc(copy_to_gen, size);
+      *new_obj_ptr = v;
+      copy_words(obj_ptr+1, new_obj_ptr+1, size-1);
+    }
+
+  push = is_gen_status_NONE(*copy_to_gen);
+  if ( push )
+    set_gen_status_SOME(*copy_to_gen);
+  gc_unlock(lock);               // the copy is complete before the forward
+                                 // pointer is installed
+  if ( untagged )
+    *(volatile uintptr_t *)(obj_ptr+1) = (uintptr_t)new_obj_ptr;
+  else
+    *(volatile uintptr_t *)obj_ptr = tag_forward_ptr(new_obj_ptr);
+
+  gc_self->copied += size;
+  if ( push )
+    gc_push_work(gc_self, GC_WORK_GEN, new_obj_ptr, NULL, NULL);
+  return (uintptr_t)new_obj_ptr;
+}
+
+static uintptr_t*
+scan_tagged_value_par(uintptr_t *s)
+{
+  return scan_tagged_value_with(s, evacuate_par);
+}
+
+// Scan the values in region page p of gen, starting at s and
+// stopping at lim (if not NULL), at the end of the page, or at the
+// end of the values in a full page. For untagged values, s points at
+// the slot before the value. Returns the scan pointer.
+static uintptr_t*
+scan_page_par(Gen *gen, Rp *p, uintptr_t *s, uintptr_t *lim)
+{
+  uintptr_t *end = (uintptr_t *)(p+1);
+
+  switch ( rtype(*gen) )
+    {
+    case RTYPE_PAIR:
+      {
+	while ( s+1 != lim && s+1 != end && *(s+1) != notPP )
+	  {
+	    gc_prefetch(*(s+2));
+	    *(s+1) = evacuate_par(*(s+1));
+	    *(s+2) = evacuate_par(*(s+2));
+	    s += 2;
+	  }
+	return s;
+      }
+    case RTYPE_REF:
+      {
+	while ( s+1 != lim && s+1 != end && *(s+1) != notPP )
+	  {
+	    *(s+1) = evacuate_par(*(s+1));
+	    s += 1;
+	  }
+	return s;
+      }
+    case RTYPE_TRIPLE:
+      {
+	while ( s+1 != lim && s+1 != end && *(s+1) != notPP )
+	  {
+	    gc_prefetch(*(s+2));
+	    gc_prefetch(*(s+3));
+	    *(s+1) = evacuate_par(*(s+1));
+	    *(s+2) = evacuate_par(*(s+2));
+	    *(s+3) = evacuate_par(*(s+3));
+	    s += 3;
+	  }
+	return s;
+      }
+    default:
+      {
+	while ( s != lim && s != end && *s != notPP )
+	  s = scan_tagged_value_par(s);
+	return s;
+      }
+    }
+}
+
+#define is_untagged_gen(gen) \
+  (rtype(gen) == RTYPE_PAIR || rtype(gen) == RTYPE_REF || rtype(gen) == RTYPE_TRIPLE)
+
+// First scan pointer in region page p
+#define first_scan_ptr(gen,p) (((uintptr_t *)(&((p)->i))) - (is_untagged_gen(gen) ? 1 : 0))
+
+// Scan gen from s until the scan pointer reaches the allocation
+// pointer, handing out the complete pages on the way.
+static void
+scan_gen_par(uintptr_t *s)
+{
+  Rp *p = get_rp_header(s);
+  Gen *gen = p->gen;
+  volatile int *lock = gc_gen_lock(gen);
+  long off = is_untagged_gen(*gen) ? 1 : 0;
+  uintptr_t *lim;
+  Rp *lp, *q, *first;
+  long n;
+
+  gc_lock(lock);
+  lim = gen->a;
+  gc_unlock(lock);
+  for (;;)
+    {
+      lp = get_rp_header(lim-1);        // the page holding the allocation pointer
+      if ( p != lp )
+	{
+	  for ( q = clear_tospace_bit(p->n) ; q != lp ; )
+	    {
+	      first = q;
+	      for ( n = 0 ; q != lp && n < GC_SCAN_SEGMENT ; n++ )
+		q = clear_tospace_bit(q->n);
+	      gc_push_work(gc_self, GC_WORK_SEGMENT, NULL, first, q);
+	    }
+	  scan_page_par(gen, p, s, NULL);
+	  p = lp;
+	  s = first_scan_ptr(*gen, p);
+	}
+      s = scan_page_par(gen, p, s, lim);
+      gc_lock(lock);
+      if ( s + off == gen->a )
+	{
+	  set_gen_status_NONE(*gen);
+	  gc_unlock(lock);
+	  return;
+	}
+      lim = gen->a;
+      gc_unlock(lock);
+    }
+}
+
+static void
+do_work_par(GcWork *item)
+{
+  switch ( item->kind )
+    {
+    case GC_WORK_CONTAINER:
+      scan_tagged_value_par(item->s);
+      break;
+    case GC_WORK_GEN:
+      scan_gen_par(item->s);
+      break;
+    case GC_WORK_SEGMENT:
+      {
+	Rp *p;
+	Gen *gen = item->rp->gen;
+	for ( p = item->rp ; p != item->stop ; p = clear_tospace_bit(p->n) )
+	  scan_page_par(gen, p, first_scan_ptr(*gen, p), NULL);
+	break;
+      }
+    default:
+      die("GC.do_work_par: unknown kind of work");
+    }
+}
+
+// Do work until all threads run out of work. A thread may return
+// while another thread still works, but then that thread does the
+// remaining work.
+static void
+work_par(GcWorker *w)
+{
+  GcWork item;
+
+  gc_self = w;
+  for (;;)
+    {
+      if ( gc_pop_work(w, &item) || gc_steal_work(w, &item) )
+	{
+	  do_work_par(&item);
+	  continue;
+	}
+      __sync_fetch_and_add(&gc_par_idle, 1);
+      for (;;)
+	{
+	  if ( gc_par_idle == gc_par_n )
+	    return;
+	  if ( gc_work_available() )
+	    {
+	      __sync_fetch_and_sub(&gc_par_idle, 1);
+	      break;
+	    }
+	  gc_relax();
+	}
+    }
+}
+
+static void *
+gc_worker_thread(void *arg)
+{
+  long round = 0;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&gc_par_mutex);
+      while ( gc_par_round == round )
+	pthread_cond_wait(&gc_par_start, &gc_par_mutex);
+      round = gc_par_round;
+      pthread_mutex_unlock(&gc_par_mutex);
+
+      work_par((GcWorker *)arg);
+
+      pthread_mutex_lock(&gc_par_mutex);
+      if ( --gc_par_running == 0 )
+	pthread_cond_signal(&gc_par_done);
+      pthread_mutex_unlock(&gc_par_mutex);
+    }
+  return NULL;
+}
+
+// Prepare the workers for a parallel collection; the main thread is
+// worker 0 and evacuates the roots.
+static void
+init_par(void)
+{
+  long i;
+
+  if ( gc_par_created < gc_threads - 1 )
+    {
+      // Signals are handled by the main thread only
+      sigset_t all, old;
+      sigfillset(&all);
+      pthread_sigmask(SIG_BLOCK, &all, &old);
+      for ( i = gc_par_created + 1 ; i < gc_threads ; i++ )
+	{
+	  if ( pthread_create(&gc_workers[i].thread, NULL, gc_worker_thread, &gc_workers[i]) )
+	    die("GC.init_par: Unable to create GC worker thread");
+	}
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+      gc_par_created = gc_threads - 1;
+    }
+  gc_par_n = gc_threads;
+  gc_par_idle = 0;
+  for ( i = 0 ; i < gc_par_n ; i++ )
+    {
+      gc_workers[i].bot = gc_workers[i].top = 0;
+      gc_workers[i].container_n = 0;
+      gc_workers[i].copied = 0;
+      gc_workers[i].steals = 0;
+      gc_workers[i].top_max = 0;
+    }
+  gc_self = &gc_workers[0];
+}
+
+static void
+do_scan_stack_par(void)
+{
+  long i;
+
+  pthread_mutex_lock(&gc_par_mutex);
+  gc_par_running = gc_par_n - 1;
+  gc_par_round++;
+  pthread_cond_broadcast(&gc_par_start);
+  pthread_mutex_unlock(&gc_par_mutex);
+
+  work_par(&gc_workers[0]);
+
+  pthread_mutex_lock(&gc_par_mutex);
+  while ( gc_par_running )
+    pthread_cond_wait(&gc_par_done, &gc_par_mutex);
+  pthread_mutex_unlock(&gc_par_mutex);
+
+  for ( i = 0 ; i < gc_par_n ; i++ )
+    {
+      alloc_period += (sizeof(void *))*gc_workers[i].copied;
+      if ( (long)gc_workers[i].top_max > scan_sp_max )
+	scan_sp_max = (long)gc_workers[i].top_max;
+    }
+}
+
+static void
+clear_scan_container_par(void)
+{
+  long i;
+  size_t j;
+  for ( i = 0 ; i < gc_par_n ; i++ )
+    for ( j = 0 ; j < gc_workers[i].container_n ; j++ )
+      *gc_workers[i].container[j] = clear_tag_const(*gc_workers[i].container[j]);
+}
+#endif // PROFILING
+
+#ifdef ENABLE_GEN_GC
+/* --------------------------------------------------------------
+ * Card marking (see Region.h). In a minor collection, the refs and
+ * arrays in old generations that lie on a page with a marked card,
+ * and the large arrays with a marked card, are part of the root
+ * set. The cards are cleared when the pages are scanned; after the
+ * collection, a card remains marked only if the values covered by
+ * the card may point into a young generation, that is, if a scanned
+ * value was left in a young generation or if values were copied to
+ * the page during the collection.
+ * -------------------------------------------------------------- */
+
+unsigned char gc_card_table[CARD_TABLE_SIZE];
+
+#define mark_card_page(rp) (*card_of(rp) = 1)
+
+// Clear the cards of region page rp; returns 1 if a card was marked
+static inline int
+test_and_clear_cards(Rp *rp)
+{
+  unsigned char *c = card_of(rp);
+  int i, dirty = 0;
+
+  for ( i = 0 ; i < CARDS_IN_REGION_PAGE ; i++ )
+    if ( c[i] )
+      {
+	c[i] = 0;
+	dirty = 1;
+      }
+  return dirty;
+}
+
+// Does the (evacuated) value v reside in a young generation?
+static inline int
+points_into_young_gen(uintptr_t v)
+{
+  Rp *rp;
+
+  if ( is_integer(v) 
+       || points_into_dataspace((uintptr_t *)v) 
+       || is_stack_allocated((uintptr_t *)v) )
+    return 0;
+  rp = get_rp_header(v);
+  return ! is_lobj_bit(rp->n) && ! is_gen_1(*(rp->gen));
+}
+
+// Evacuate the contents of the refs or arrays on the pages with a
+// marked card in the old generation gen. Only the values allocated
+// before this collection (below colorPtr) are scanned; values copied
+// to gen during the collection are scanned through the scan stack.
+static void
+scan_dirty_pages(Gen *gen, Evacuator evacuate_root)
+{
+  Rp *rp;
+  uintptr_t *s;
+  size_t i, sz;
+  int young;
+
+  for ( rp = clear_fp(gen->fp) ; rp ; rp = clear_tospace_bit(rp->n) )
+    {
+      if ( ! test_and_clear_cards(rp) )
+	continue;
+      young = 0;
+      s = (uintptr_t *)&(rp->i);
+      while ( s < rp->colorPtr && *s != notPP )
+	{
+         #ifdef PROFILING
+	  s += sizeObjectDesc;
+         #endif // PROFILING
+	  if ( is_refregion(*gen) )      // refs are untagged and
+	    sz = 1;                      // occupy one word only
+	  else
+	    sz = get_table_size(*s++);
+	  for ( i = 0 ; i < sz ; i++, s++ )
+	    {
+	      *s = evacuate_root(*s);
+	      young |= points_into_young_gen(*s);
+	    }
+	}
+      if ( young )
+	mark_card_page(rp);
+    }
+}
+
+// Clear the cards of the large arrays in region r that no longer
+// point into a young generation
+static void
+recheck_lobj_cards(Ro *r)
+{
+  Lobjs *lobjs;
+  uintptr_t *value_ptr;
+  size_t i, sz;
+
+  for ( lobjs = r->lobjs ; lobjs ; lobjs = clear_lobj_bit(lobjs->next) ) 
+    {
+      if ( ! *card_of(lobjs) )
+	continue;
+      value_ptr = &(lobjs->value);
+     #ifdef PROFILING
+      value_ptr += sizeObjectDesc;
+     #endif
+      sz = get_table_size(*value_ptr);
+      for ( i = 1 ; i <= sz ; i++ )
+	if ( points_into_young_gen(value_ptr[i]) )
+	  break;
+      if ( i > sz )
+	*card_of(lobjs) = 0;
+    }
+}
+#endif // ENABLE_GEN_GC
+
+// Clear the tospace-bit and update colorPtr in the pages of gen
+// from page p and on
+inline static void 
+clear_tospace_bit_and_set_colorPtr_in_pages(Gen *gen, Rp *p) 
+{
+  for ( ; p ; p = p->n ) 
+    {
+      // Clear tospace-bit - in minor gc, pages in g1 are not marked!
+#ifdef CHECK_GC
+      if ( ! is_tospace_bit(p->n) 
+#ifdef ENABLE_GEN_GC
+	   && ( is_major_p || ! is_gen_1(*gen) ) 
+#elif !defined(PROFILING)
+	   && p->gen != &gc_kept_gen        // see mr_mark
+	   && ! is_kept_string_gen(*gen)
+#endif // ENABLE_GEN_GC
+	   )
+	die ("gc: page in tospace not marked in major gc");
+#endif // CHECK_GC
+      p->n = clear_tospace_bit(p->n);
+
+#ifdef ENABLE_GEN_GC
+      // Values copied to a page of refs or arrays in an old
+      // generation may point into a young generation
+      if ( is_gen_1(*gen) && (is_refregion(*gen) || is_arrayregion(*gen))
+	   && p->colorPtr != (p->n ? (uintptr_t *)(p+1) : gen->a) )
+	mark_card_page(p);
+
+      // Update colorPtr
+      if ( p->n ) // tospace-bit has been cleared
+	p->colorPtr = (uintptr_t *) (p+1); // Not last page so entire page is black
+      else
+	p->colorPtr = gen->a; // Last page so only allocated part of page is black
+#endif // ENABLE_GEN_GC
+    }
+}
+
+inline static void 
+clear_tospace_bit_and_set_colorPtr_in_gen(Gen *gen) 
+{
+  clear_tospace_bit_and_set_colorPtr_in_pages(gen, clear_fp(gen->fp));
+}
+
+#ifdef ENABLE_GEN_GC
+// With -gc_max_pause_us n, the young generations are collected when
+// rp_young_limit region pages have been allocated since the last
+// collection. The time of a minor collection grows with the values
+// that survive it, and thus with the pages allocated since the last
+// collection, so after each minor collection the limit is scaled by
+// n over the pause; the result is averaged with the old limit to
+// damp the variation between collections.
+static void
+adjust_young_limit(long pause_us)
+{
+  double limit = (double)(rp_young_limit ? rp_young_limit : rp_young);
+
+  if ( pause_us < 1 )
+    pause_us = 1;
+  limit = (limit + limit * (double)gc_max_pause_us / (double)pause_us) / 2.0;
+  if ( rp_gc_treshold && limit > (double)rp_gc_treshold )
+    limit = (double)rp_gc_treshold;
+  if ( limit < GC_MIN_YOUNG_PAGES )
+    limit = GC_MIN_YOUNG_PAGES;
+  rp_young_limit = (size_t)limit;
+}
+#endif // ENABLE_GEN_GC
+
+#define predSPDef(sp,n) ((sp)+=(n))
+#define succSPDef(sp) (sp--)
+
+#ifdef CHECK_GC
+void
+check_all_lobjs(void)    // used for debugging
+{
+  Region r;
+  //printf("[check_all_lobjs begin]\n");
+  for( r = TOP_REGION ; r ; r = r->p ) 
+    {
+      Lobjs *lobjs;
+      for ( lobjs = r->lobjs ; lobjs ; lobjs = clear_lobj_bit(lobjs->next) )
+	{
+	  uintptr_t* tag_ptr;
+	  //uintptr_t sz;
+#ifdef PROFILING
+	  tag_ptr = &(*(&(lobjs->value) + sizeObjectDesc));
+#else
+	  tag_ptr = &(lobjs->value);
+#endif
+	  //sz = size_lobj(*tag_ptr);
+	  //printf("  size_lobj: %d\n", sz);
+	  if ( is_const(*tag_ptr) )
+	    die ("check_lobjs: lobj constant bit set");
+	  if ( !is_lobj_bit(lobjs->next) )
+	    die ("check_lobjs: lobj bit not set"); 
+	}
+    }
+  //printf("[check_all_lobjs end]\n");
+}
+#endif // CHECK_GC
+
+double
+region_utilize(size_t pages, size_t bytes)
+{
+  if ( pages > 0 )
+    return (100.0 * (double)bytes 
+	    / ((double)pages * (sizeof(void *)) * ALLOCATABLE_WORDS_IN_REGION_PAGE));
+  else 
+    return 0.0;
+}
+
+static unsigned long long
+gc_now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long long)t.tv_sec * 1000000000ULL + (unsigned long long)t.tv_nsec;
+}
+
+// With -gc_target_overhead p, retune the heap to live ratio r after
+// each collection. Between two collections, the program allocates
+// about (r-1)L pages, where L is the live data, so at a given
+// allocation rate, the time between collections is proportional to
+// r-1 and the fraction o of time spent in GC satisfies o/(1-o) ~
+// 1/(r-1). The fraction is observed as decaying sums over the recent
+// collections, and r is moved towards the ratio that would give p%,
+// by at most a factor of two per collection. With -max_heap n, the
+// ratio used is then capped so that r times the live data (region
+// pages in use and large objects) stays below n.
+static void
+adapt_heap_to_live_ratio(unsigned long long begin_ns, unsigned long long end_ns)
+{
+  extern long rp_total;
+  double r, live_kb;
+
+  if ( adapt_ratio == 0.0 )
+    adapt_ratio = heap_to_live_ratio;
+  if ( gc_target_overhead > 0.0 && adapt_last_end_ns )
+    {
+      double o, t = gc_target_overhead / 100.0, f;
+      adapt_gc_ns = adapt_gc_ns / 2.0 + (double)(end_ns - begin_ns);
+      adapt_all_ns = adapt_all_ns / 2.0 + (double)(end_ns - adapt_last_end_ns);
+      o = adapt_gc_ns / adapt_all_ns;
+      if ( o > 0.99 )
+	o = 0.99;
+      f = (o * (1.0 - t)) / (t * (1.0 - o));
+      if ( f > 2.0 ) f = 2.0;
+      if ( f < 0.5 ) f = 0.5;
+      adapt_ratio = 1.0 + (adapt_ratio - 1.0) * f;
+      if ( adapt_ratio > GC_MAX_HEAP_TO_LIVE_RATIO )
+	adapt_ratio = GC_MAX_HEAP_TO_LIVE_RATIO;
+      if ( adapt_ratio < GC_MIN_HEAP_TO_LIVE_RATIO )
+	adapt_ratio = GC_MIN_HEAP_TO_LIVE_RATIO;
+    }
+  adapt_last_end_ns = end_ns;
+
+  r = adapt_ratio;
+  live_kb = (double)pages_to_kb(rp_total - size_free_list()) + (double)lobjs_current / 1024.0;
+  if ( max_heap_kb && live_kb > 0.0 && r * live_kb > (double)max_heap_kb )
+    r = (double)max_heap_kb / live_kb;
+  if ( r < GC_MIN_HEAP_TO_LIVE_RATIO )
+    r = GC_MIN_HEAP_TO_LIVE_RATIO;
+  heap_to_live_ratio = r;
+}
+
+// Evacuate the root-set: the live registers, the arguments to the
+// current function, the values in the frames on the stack (as
+// described by the frame descriptors), and the data labels.
+static void
+evacuate_roots(uintptr_t **sp, size_t reg_map, Evacuator evacuate_root)
+{
+  uintptr_t **sp_ptr;
+  uintptr_t *fd_ptr;
+  uintptr_t fd_size, fd_offset_to_return;
+  uintptr_t *w_ptr;
+  long w_idx;
+  uintptr_t w;
+  long offset;
+  uintptr_t *value_ptr;
+  long num_d_labs;
+  long size_rcf, size_ccf, size_spilled_region_args;
+
+  // Search for live registers
+  sp_ptr = sp;
+  w = reg_map;
+  for ( offset = 0 ; offset < NUM_REGS ; offset++ ) {
+    if ( w & 1 ) {
+      value_ptr = ((uintptr_t *)sp_ptr) + NUM_REGS - 1 - offset;  /* Address of live cell */
+      *value_ptr = evacuate_root(*value_ptr);
+    }
+    w = w >> 1;
+  }
+
+  // Do spilled arguments and results to current function
+  sp_ptr = sp;
+  sp_ptr = sp_ptr + NUM_REGS;   // points at size_spilled_region_args
+
+  size_spilled_region_args = *((long *)sp_ptr);
+  predSPDef(sp_ptr,1);          // sp_ptr points at size_rcf
+  size_rcf = *((long *)sp_ptr);
+  predSPDef(sp_ptr,1);          // sp_ptr points at size_ccf
+  size_ccf = *((long *)sp_ptr);
+  predSPDef(sp_ptr,1);          // sp_ptr points at last arg. to current function
+
+  // All arguments to current function are live - except for region arguments.
+  for ( offset = 0 ; offset < size_ccf ; offset++ ) {
+    value_ptr = ((uintptr_t *)sp_ptr);
+    predSPDef(sp_ptr,1);
+    if ( offset >= size_spilled_region_args ) 
+      {
+	*value_ptr = evacuate_root(*value_ptr);    
+      }
+  }
+
+  /* sp_ptr points at first return address.                           */  
+  /* Below the return address we may have slots for spilled results - */
+  /* they are not live at this point!                                 */
+
+  /* Search for Frame Descriptors (FD). A FD cover */
+  /*   - function frame                            */
+  /*   - spilled arguments                         */
+  /*   - return address                            */
+  /*   - spilled results                           */
+
+  fd_ptr = *sp_ptr;
+  fd_offset_to_return = *(fd_ptr-2);
+  fd_size = *(fd_ptr-3);
+  predSPDef(sp_ptr,size_rcf);
+
+  // sp_ptr points at first address before FD
+  while ( fd_size != /* 0xFFFFFFFF */ UINTPTR_MAX) 
+    {
+      // Analyse frame
+      
+      w_ptr = fd_ptr-4;
+    
+      // Find RootSet in FD
+      if ( fd_size )  // fd_size may be 0 in which case w_ptr points at arbitrary address.
+	w = *w_ptr;
+      w_idx = 0;
+      for( offset = 0 ; offset < fd_size ; offset++ ) 
+	{
+	  if (w & 1) {
+	    // Evacuate value in frame
+	    value_ptr = ((uintptr_t *)sp_ptr) + fd_size - offset;
+	    *value_ptr = evacuate_root(*value_ptr); 
+	  }
+	  w = w >> 1;
+	  w_idx++;
+	  if ((w_idx == 32) & (offset+1 < fd_size)) 
+	    { 
+	      // Again, w_ptr may point arbitrarily if we are done.
+	      w_ptr--;
+	      w = *w_ptr;
+	      w_idx = 0;
+	    }
+	}
+      
+      sp_ptr = sp_ptr + fd_offset_to_return + 1; // Points at next return address.
+      fd_ptr = *sp_ptr;
+      fd_offset_to_return = *(fd_ptr-2);
+      fd_size = *(fd_ptr-3);
+      predSPDef(sp_ptr,size_rcf);
+    }
+
+  // Search for data labels; they are part of the root-set.
+  num_d_labs = *data_lab_ptr; /* Number of data labels */
+  for ( offset = 1 ; offset <= num_d_labs ; offset++ ) {
+    // Evacuate value in data labels
+    value_ptr = *(((uintptr_t **)data_lab_ptr) + offset);
+    *value_ptr = evacuate_root(*value_ptr);
+  }
+}
+
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+/*************************************************************/
+/* MARK-REGION COLLECTIONS                                   */
+/*                                                           */
+/* With -gc_mark_region p, a collection first marks the live */
+/* values, recording for each region page a bitmap of the    */
+/* first words of its live values and the number of live     */
+/* words. Pages in which at least p% of the words are live   */
+/* are kept in place, whereas the live values of the other   */
+/* pages are copied as usual. During the collection, the gen */
+/* field of a kept page points at gc_kept_gen, by which      */
+/* evacuate recognises the values of the page; the live      */
+/* values of kept pages are scanned using the bitmaps, and   */
+/* the dead values in kept pages are never looked at. Large  */
+/* objects and values in finite regions are marked with the  */
+/* immovable-bit, as in evacuate, which is cleared again     */
+/* before copying. The mode is available in the sequential   */
+/* collector without generations and profiling.             */
+/*************************************************************/
+
+static MrPage *
+mr_page(Rp *rp)
+{
+  size_t h = (((uintptr_t)rp / REGION_PAGE_SIZE) * 2654435761UL) & (mr_size - 1);
+
+  while ( mr_pages[h].rp != rp )
+    {
+      if ( mr_pages[h].rp == NULL )
+	{
+	  mr_pages[h].rp = rp;
+	  mr_pages[h].gen = rp->gen;
+	  break;
+	}
+      h = (h + 1) & (mr_size - 1);
+    }
+  return &mr_pages[h];
+}
+
+// Mark the value x and push it on the scan stack if it was not marked
+// already; the value is returned, so that mark_value can be used as
+// an evacuator.
+static uintptr_t
+mark_value(uintptr_t x)
+{
+  uintptr_t *p, *first;
+  Rp *rp;
+  MrPage *m;
+  size_t i, size;
+
+  if ( is_integer(x) )
+    return x;
+  p = (uintptr_t *)x;
+  if ( points_into_dataspace(p) )
+    return x;
+  if ( is_stack_allocated(p) || is_lobj_bit((rp = get_rp_header(p))->n) )
+    {
+      if ( ! is_const(*p) )
+	{
+	  *p = set_tag_const(*p);
+	  push_scan_container(p);
+	  push_scan_stack(p);
+	}
+      return x;
+    }
+  if ( is_kept_string_gen(*(rp->gen)) )
+    return x;
+  first = ((uintptr_t *)rp) + HEADER_WORDS_IN_REGION_PAGE;
+  switch ( rtype(*(rp->gen)) ) {
+  case RTYPE_PAIR:   size = 2; i = p + 1 - first; break;
+  case RTYPE_REF:    size = 1; i = p + 1 - first; break;
+  case RTYPE_TRIPLE: size = 3; i = p + 1 - first; break;
+  default:           size = get_size_obj(p); i = p - first;
+  }
+  m = mr_page(rp);
+  if ( m->bits[i/32] & (1U << (i%32)) )
+    return x;
+  m->bits[i/32] |= 1U << (i%32);
+  m->live += size;
+  push_scan_stack(p);
+  return x;
+}
+
+// Mark the values reachable from the root-set, and choose the pages
+// to keep in place
+static void
+mr_mark(uintptr_t **sp, size_t reg_map)
+{
+  extern long rp_total;
+  size_t n = 1024, i, dense;
+  uintptr_t *p;
+
+  while ( n < 2 * (size_t)(rp_total - size_free_list()) )
+    n *= 2;
+  if ( n > mr_size )
+    {
+      mr_pages = (MrPage *) realloc((void *)mr_pages, n * sizeof(MrPage));
+      if ( mr_pages == NULL )
+	die("GC.mr_mark: Unable to allocate page table");
+      mr_size = n;
+    }
+  memset(mr_pages, 0, mr_size * sizeof(MrPage));
+
+  evacuate_roots(sp, reg_map, mark_value);
+  while ( ! is_scan_stack_empty() )
+    {
+      p = pop_scan_stack();
+      if ( is_stack_allocated(p) || is_lobj_bit(get_rp_header(p)->n) )
+	{
+	  scan_tagged_value_with(p, mark_value);
+	  continue;
+	}
+      switch ( rtype(*(get_rp_header(p)->gen)) ) {
+      case RTYPE_TRIPLE:
+	mark_value(*(p+3));
+      case RTYPE_PAIR:
+	mark_value(*(p+2));
+      case RTYPE_REF:
+	mark_value(*(p+1));
+	break;
+      default:
+	scan_tagged_value_with(p, mark_value);
+      }
+    }
+  clear_scan_container();
+  init_scan_container();
+
+  dense = (size_t)gc_mark_region * ALLOCATABLE_WORDS_IN_REGION_PAGE / 100;
+  mr_kept = 0;
+  for ( i = 0 ; i < mr_size ; i++ )
+    if ( mr_pages[i].rp && mr_pages[i].live >= dense )
+      {
+	mr_pages[i].rp->gen = &gc_kept_gen;
+	mr_kept++;
+      }
+}
+
+// Evacuate the fields of the live values in kept pages
+static void
+mr_scan_kept(void)
+{
+  size_t i, j, k, size;
+  uintptr_t *first, *p;
+  MrPage *m;
+
+  for ( i = 0 ; i < mr_size ; i++ )
+    {
+      m = &mr_pages[i];
+      if ( m->rp == NULL || m->rp->gen != &gc_kept_gen )
+	continue;
+      first = ((uintptr_t *)m->rp) + HEADER_WORDS_IN_REGION_PAGE;
+      switch ( rtype(*(m->gen)) ) {
+      case RTYPE_PAIR:   size = 2; break;
+      case RTYPE_REF:    size = 1; break;
+      case RTYPE_TRIPLE: size = 3; break;
+      default:           size = 0;
+      }
+      for ( j = 0 ; j < MR_BITMAP_WORDS ; j++ )
+	{
+	  if ( m->bits[j] == 0 )
+	    continue;
+	  for ( k = 0 ; k < 32 ; k++ )
+	    if ( m->bits[j] & (1U << k) )
+	      {
+		p = first + 32*j + k;
+		if ( size == 0 )
+		  scan_tagged_value(p);
+		else
+		  for ( ; p < first + 32*j + k + size ; p++ )
+		    *p = evacuate(*p);
+	      }
+	}
+    }
+}
+
+// Give the kept pages their generations back
+static void
+mr_restore(void)
+{
+  size_t i;
+  for ( i = 0 ; i < mr_size ; i++ )
+    if ( mr_pages[i].rp && mr_pages[i].rp->gen == &gc_kept_gen )
+      mr_pages[i].rp->gen = mr_pages[i].gen;
+  mr_kept = 0;
+}
+#endif // !ENABLE_GEN_GC && !PROFILING
+
+static const char *gc_trigger_names[] = {"heap", "extend", "lobjs", "young"};
+
+// Write an event for the collection to the -gc_log file; one line of
+// JSON or, if the file name ends in .csv, of comma separated values.
+// Page counts are in region pages, the sizes of large objects in
+// bytes, and the times are in ns on the monotonic clock.
+static void
+gc_log_event(int major, size_t trigger, unsigned long long begin_ns, unsigned long long end_ns,
+	     size_t from_pages, size_t to_pages, size_t heap_pages,
+	     size_t lobjs_before, size_t lobjs_after)
+{
+  if ( gc_log_file == NULL )
+    {
+      size_t n = strlen(gc_log);
+      gc_log_file = fopen(gc_log, "w");
+      if ( gc_log_file == NULL )
+	die("gc: unable to open the -gc_log file");
+      gc_log_csv = (n >= 4 && strcmp(gc_log + n - 4, ".csv") == 0);
+      if ( gc_log_csv )
+	fprintf(gc_log_file, "gc,kind,trigger,begin_ns,end_ns,from_pages,to_pages,"
+		"heap_pages,lobjs_before,lobjs_after,scan_stack_max,heap_to_live_ratio\n");
+    }
+  if ( gc_log_csv )
+    fprintf(gc_log_file, "%zd,%s,%s,%llu,%llu,%zu,%zu,%zu,%zu,%zu,%ld,%.3f\n",
+	    num_gc, major ? "major" : "minor", gc_trigger_names[trigger],
+	    begin_ns, end_ns, from_pages, to_pages, heap_pages,
+	    lobjs_before, lobjs_after, scan_sp_max, heap_to_live_ratio);
+  else
+    fprintf(gc_log_file, "{\"gc\":%zd,\"kind\":\"%s\",\"trigger\":\"%s\","
+	    "\"begin_ns\":%llu,\"end_ns\":%llu,\"from_pages\":%zu,\"to_pages\":%zu,"
+	    "\"heap_pages\":%zu,\"lobjs_before\":%zu,\"lobjs_after\":%zu,"
+	    "\"scan_stack_max\":%ld,\"heap_to_live_ratio\":%.3f}\n",
+	    num_gc, major ? "major" : "minor", gc_trigger_names[trigger],
+	    begin_ns, end_ns, from_pages, to_pages, heap_pages,
+	    lobjs_before, lobjs_after, scan_sp_max, heap_to_live_ratio);
+}
+
+static void
+gc_record_pause(unsigned long long pause_ns)
+{
+  if ( (size_t)num_gc > gc_pauses_size )
+    {
+      gc_pauses_size = gc_pauses_size ? 2 * gc_pauses_size : 1024;
+      gc_pauses = (unsigned long long *) realloc((void *)gc_pauses,
+						 gc_pauses_size * sizeof(unsigned long long));
+      if ( gc_pauses == NULL )
+	die("gc_record_pause: Unable to allocate pause table");
+    }
+  gc_pauses[num_gc-1] = pause_ns;
+}
+
+static int
+cmp_pause(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+  return (x > y) - (x < y);
+}
+
+// Print percentiles of the (real time) pauses of all collections;
+// called from terminateML with -report_gc and -verbose_gc.
+void
+report_gc_pauses(void)
+{
+  size_t n = (size_t)num_gc;
+  if ( n == 0 || gc_pauses == NULL )
+    return;
+  qsort(gc_pauses, n, sizeof(unsigned long long), cmp_pause);
+#define pause_ms(p) ((double)gc_pauses[(size_t)((p) * (double)(n-1))] / 1e6)
+  fprintf(stderr, "[GC pauses: p50 %.3fms, p90 %.3fms, p99 %.3fms, max %.3fms]\n",
+	  pause_ms(0.50), pause_ms(0.90), pause_ms(0.99), pause_ms(1.0));
+#undef pause_ms
+  fflush(stderr);
+}
+ 
+void 
+gc(uintptr_t **sp, size_t reg_map) 
+{
+  long time_gc_one_ms = 0;
+  extern long rp_used;
+  extern long rp_total;
+  struct rusage rusage_begin;
+  struct rusage rusage_end;
+  unsigned long long real_begin;      // the pause in ns; with -gc_threads n, it is
+  unsigned long long real_end;        //   reported as well as the processor time
+  size_t trigger = gc_trigger;
+  size_t pages_before = 0;
+  size_t lobjs_before = lobjs_current;
+  size_t bytes_from_space = 0;
+  size_t pages_from_space = 0;
+  size_t alloc_period_save = 0;
+  Ro *r;
+  Evacuator evacuate_root = evacuate;
+#ifdef ENABLE_GEN_GC
+  ssize_t minor_gc;
+  size_t i_g1;
+#endif // ENABLE_GEN_GC
+
+  // Mutex on the garbage collector; used by alloc_new_block in
+  // Region.c for determining whether the tospace-bit should be set on
+  // new allocated pages.
+  doing_gc = 1; 
+
+#ifdef ENABLE_GEN_GC
+  // See code below after GC proper
+  //  major_p = (major_p==0)?(1):(0);
+  //  major_p = 0;
+  if ( only_major_gc )
+    major_p = 1;
+  minor_gc = is_minor_p;
+#endif
+
+  stack_top_gc = (uintptr_t *)sp;
+
+#ifdef CHECK_GC
+  if ((ssize_t)(stack_bot_gc - stack_top_gc) < 0)
+    {
+      die("gc: stack_top_gc larger than stack_bot_gc on down-growing stack");
+    }
+#endif // CHECK_GC
+
+  num_gc++;
+  real_begin = gc_now_ns();
+  if ( gc_log )
+    pages_before = rp_total - size_free_list();
+
+  if ( verbose_gc || report_gc )
+    {
+      getrusage(RUSAGE_SELF, &rusage_begin);
+#ifdef ENABLE_GEN_GC
+      if ( major_p )
+	num_gc_major++;
+#endif // ENABLE_GEN_GC
+    }
+
+  if ( verbose_gc ) 
+    {
+      fprintf(stderr,"[%s#%zd",
+#ifdef ENABLE_GEN_GC	      
+	      (is_major_p)?("GC"):("gc"),
+#else
+	      "GC",
+#endif
+	      num_gc);
+      fflush(stderr);
+      bytes_from_space = allocated_bytes_in_regions();
+      pages_from_space = allocated_pages_in_regions();
+      lobjs_beforegc = allocated_bytes_in_lobjs();
+      alloc_period_save = alloc_period;
+      alloc_period = 0;
+    }
+
+  // Initialize the scan stack (for Infinite Regions) and the
+  // container (for Finite Regions and large objects)
+  init_scan_stack();
+  init_scan_container();
+#ifndef PROFILING
+  if ( gc_threads > 1 )
+    {
+      init_par();
+      evacuate_root = evacuate_par;
+    }
+#endif // PROFILING
+
+#ifdef ENABLE_GEN_GC
+#ifdef CHECK_GC
+  chk_no_tospacebits_regions();
+
+  for ( r = TOP_REGION ; r ; r = r->p )
+    {
+      Rp* rp;
+      for ( rp = clear_fp(r->g1.fp) ; rp ; rp = clear_tospace_bit(rp->n) )
+	{
+	  if ( clear_tospace_bit(rp->n) )
+	    {
+	      if ( rp->colorPtr != (uintptr_t *)(rp+1) )
+		{
+		  pp_gen(&(r->g1));
+		  printf("r->g1.b=%p\n", r->g1.b);
+		  die ("problem with middle page");	
+		}
+	    }
+	  else 
+	    // last page
+	    if ( rp->colorPtr != (uintptr_t *)(r->g1.a) )
+	      {
+		printf("rp->colorPtr=%p - r->g1.a=%p\n", rp->colorPtr, r->g1.a);
+		pp_gen(&(r->g1));
+		die ("problem with final page");
 	      }
 	}
     }
 #endif // CHECK_GC
 #endif // ENABLE_GEN_GC
 
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  gc_strings_kept = num_gc % GC_STRING_REGION_PERIOD != 0;
+  if ( gc_mark_region && gc_threads == 1 )
+    mr_mark(sp, reg_map);
+#endif
+
   mk_from_space();
 
 #ifdef ENABLE_GEN_GC
   if ( is_minor_p ) {
     // If minor gc then refs and arrays in old generations (g1) 
     // and lobjs (i.e., for large arrays) are also considered 
-    // part of the root-set...
+    // part of the root-set - but only those that have been
+    // updated since the last collection, which is recorded by
+    // card marking (see scan_dirty_pages).
     for ( r = TOP_REGION ; r ; r = r->p ) {
       switch ( rtype(r->g1) ) {
-      case RTYPE_REF: {      // Refs are untagged
-	value_ptr = ((uintptr_t *)clear_fp(r->g1.fp))+HEADER_WORDS_IN_REGION_PAGE - 1;
-	// evacuate content of refs in g1
-	// refs occupies one word only!
-	while ( (value_ptr + 1) != r->g1.a ) 
-	  {
-           #if PROFILING
-	    value_ptr += sizeObjectDesc;
-           #endif // PROFILING
-	    *(value_ptr+1) = evacuate(*(value_ptr+1)); 
-	    value_ptr = next_untagged_value(value_ptr+1,r->g1.a);
-	  }
+      case RTYPE_REF: {
+	scan_dirty_pages(&(r->g1), evacuate_root);
 	break;
       }
       case RTYPE_ARRAY: { 
-	size_t tag;
-	ssize_t i, sz;
 	Lobjs *lobjs;    
-	
-	value_ptr = ((uintptr_t *)clear_fp(r->g1.fp))+HEADER_WORDS_IN_REGION_PAGE;
-	// evacuate content of arrays in g1
-	while ( (value_ptr) != r->g1.a ) 
-	  { 
-           #if PROFILING
-	    value_ptr += sizeObjectDesc;
-           #endif // PROFILING
-	    tag = *value_ptr;
-	    sz = get_table_size(tag);
-	    value_ptr++; // Point at first element in array
-	    for ( i = 0 ; i < sz ; i++ ) {
-	      *value_ptr = evacuate(*value_ptr);
-	      value_ptr++;
-	    }
-	    value_ptr = next_value(value_ptr, r->g1.a);
-	  }
+	uintptr_t *value_ptr;
+
+	scan_dirty_pages(&(r->g1), evacuate_root);
 
 	// evacuate contents of arrays in lobjs
 	for ( lobjs = r->lobjs ; lobjs ; lobjs = clear_lobj_bit(lobjs->next) ) 
 	  {
+	    if ( ! *card_of(lobjs) )
+	      continue;
 	    value_ptr = &(lobjs->value);
             #ifdef PROFILING
 	    value_ptr += sizeObjectDesc;
@@ -1434,6 +2832,11 @@ gc(uintptr_t **sp, size_t reg_map)
 	    // The const-bit could have been set already; the previous calls to
 	    // evacuate could have caused large objects to be be pushed onto the
 	    // scan container! mael 2005-11-14
+#ifndef PROFILING
+	    if ( gc_threads > 1 )
+	      gc_par_mark_immovable(value_ptr);
+	    else
+#endif // PROFILING
 	    if ( ! is_const(*value_ptr) )
 	      {
 		//fprintf(stderr, "Array %p is NOT visited (0x%x)\n", value_ptr, *value_ptr);
@@ -1453,102 +2856,23 @@ gc(uintptr_t **sp, size_t reg_map)
   }
 #endif // ENABLE_GEN_GC
 
-  // Search for live registers
-  sp_ptr = sp;
-  w = reg_map;
-  for ( offset = 0 ; offset < NUM_REGS ; offset++ ) {
-    if ( w & 1 ) {
-      value_ptr = ((uintptr_t *)sp_ptr) + NUM_REGS - 1 - offset;  /* Address of live cell */
-      *value_ptr = evacuate(*value_ptr);
-    }
-    w = w >> 1;
-  }
-
-  // Do spilled arguments and results to current function
-  sp_ptr = sp;
-  sp_ptr = sp_ptr + NUM_REGS;   // points at size_spilled_region_args
-
-  size_spilled_region_args = *((long *)sp_ptr);
-  predSPDef(sp_ptr,1);          // sp_ptr points at size_rcf
-  size_rcf = *((long *)sp_ptr);
-  predSPDef(sp_ptr,1);          // sp_ptr points at size_ccf
-  size_ccf = *((long *)sp_ptr);
-  predSPDef(sp_ptr,1);          // sp_ptr points at last arg. to current function
-
-  // All arguments to current function are live - except for region arguments.
-  for ( offset = 0 ; offset < size_ccf ; offset++ ) {
-    value_ptr = ((uintptr_t *)sp_ptr);
-    predSPDef(sp_ptr,1);
-    if ( offset >= size_spilled_region_args ) 
-      {
-	*value_ptr = evacuate(*value_ptr);    
-      }
-  }
-
-  /* sp_ptr points at first return address.                           */  
-  /* Below the return address we may have slots for spilled results - */
-  /* they are not live at this point!                                 */
-
-  /* Search for Frame Descriptors (FD). A FD cover */
-  /*   - function frame                            */
-  /*   - spilled arguments                         */
-  /*   - return address                            */
-  /*   - spilled results                           */
-
-  fd_ptr = *sp_ptr;
-  fd_offset_to_return = *(fd_ptr-2);
-  fd_size = *(fd_ptr-3);
-  predSPDef(sp_ptr,size_rcf);
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  if ( mr_kept )
+    mr_scan_kept();
+#endif
 
-  // sp_ptr points at first address before FD
-  while ( fd_size != /* 0xFFFFFFFF */ UINTPTR_MAX) 
-    {
-      // Analyse frame
-      
-      w_ptr = fd_ptr-4;
-    
-      // Find RootSet in FD
-      if ( fd_size )  // fd_size may be 0 in which case w_ptr points at arbitrary address.
-	w = *w_ptr;
-      w_idx = 0;
-      for( offset = 0 ; offset < fd_size ; offset++ ) 
-	{
-	  if (w & 1) {
-	    // Evacuate value in frame
-	    value_ptr = ((uintptr_t *)sp_ptr) + fd_size - offset;
-	    *value_ptr = evacuate(*value_ptr); 
-	  }
-	  w = w >> 1;
-	  w_idx++;
-	  if ((w_idx == 32) & (offset+1 < fd_size)) 
-	    { 
-	      // Again, w_ptr may point arbitrarily if we are done.
-	      w_ptr--;
-	      w = *w_ptr;
-	      w_idx = 0;
-	    }
-	}
-      
-      sp_ptr = sp_ptr + fd_offset_to_return + 1; // Points at next return address.
-      fd_ptr = *sp_ptr;
-      fd_offset_to_return = *(fd_ptr-2);
-      fd_size = *(fd_ptr-3);
-      predSPDef(sp_ptr,size_rcf);
-    }
+  evacuate_roots(sp, reg_map, evacuate_root);
 
-  // Search for data labels; they are part of the root-set.
-  num_d_labs = *data_lab_ptr; /* Number of data labels */
-  for ( offset = 1 ; offset <= num_d_labs ; offset++ ) {
-    // Evacuate value in data labels
-    value_ptr = *(((uintptr_t **)data_lab_ptr) + offset);
-    *value_ptr = evacuate(*value_ptr);
-  }
-  
+#ifndef PROFILING
+  if ( gc_threads > 1 )
+    do_scan_stack_par();
+  else
+#endif // PROFILING
   do_scan_stack();
 
   // We Are Done And Can Now Insert from-space Into The FreeList
-  from_space_end->n = freelist;
-  freelist = from_space_begin;
+  if ( from_space_begin )
+    free_from_space(from_space_begin, from_space_end, from_space_pages);
 
   // If major GC run through all infinite regions and free all large
   // objects that have not been visited (are not marked as constant);
@@ -1592,11 +2916,10 @@ gc(uintptr_t **sp, size_t reg_map)
 	      }
 	    else // do not preserve object
 	      {	     
-		char* orig;
+		Lobjs* dead = lobjs;
 		lobjs_current -= size_lobj(*tag_ptr);
-		orig = lobjs->orig;
 		lobjs = clear_lobj_bit(lobjs->next);
-		free(orig);            // deallocate object
+		free_lobj(dead);       // deallocate object
 	      }
 	  }
 	
@@ -1609,32 +2932,38 @@ gc(uintptr_t **sp, size_t reg_map)
   // Unmark all tospace bits in region pages in regions on the stack
   // Update colorPtr in all region pages.
 
-  // MEMO: I don't understand why old generation pages are marked
-  // during a minor collection - all what should be necessary is to
-  // update colorPtr to the generation allocation pointer in last
-  // pages in old generation, but this should happen before garbage
-  // collection; the colorPtr is used in old generations only to help gc
-  // determine that an object points into to-space. mael 2005-03-19
-
-  // MEMO: It is not nice that we need to run through all pages during
-  // a minor collection - this means that we basically traverse ALL
-  // live data during a minor collection. A better solution would be
-  // the following: During a minor collection, the colorPtr is used as
-  // the sole mechanism for determining if an object in an old
-  // generation is part of to-space (allocated memory during
-  // gc). After gc, we mark black all non-black data in old generation
-  // pages. This can be done efficiently, by storing information about
-  // old-generation last-pages before gc proper, so that the
-  // information is available after gc. mael 2005-03-19
-
+  // In an old generation, a value at or above the colorPtr of its
+  // page was copied there during the collection and so is in
+  // to-space. Once the collection is over, colorPtr is moved to the
+  // end of the values on the page. In a major collection all pages
+  // are visited. In a minor collection, values are only copied into
+  // an old generation from the last page it had before the collection
+  // (recorded in g1_last_pages by mk_from_space), so the walk starts
+  // there and is proportional to the promoted data, not to the old
+  // generations.
 
+#ifdef ENABLE_GEN_GC
+  i_g1 = 0;
+#endif /* ENABLE_GEN_GC */
   for( r = TOP_REGION ; r ; r = r->p ) 
     {
       clear_tospace_bit_and_set_colorPtr_in_gen(&(r->g0));
 #ifdef ENABLE_GEN_GC
-      clear_tospace_bit_and_set_colorPtr_in_gen(&(r->g1));
+      if ( is_minor_p )
+	clear_tospace_bit_and_set_colorPtr_in_pages(&(r->g1), g1_last_pages[i_g1++]);
+      else
+	clear_tospace_bit_and_set_colorPtr_in_gen(&(r->g1));
+      if ( is_arrayregion(r->g1) )
+	recheck_lobj_cards(r);
 #endif /* ENABLE_GEN_GC */
     }
+#if !defined(ENABLE_GEN_GC) && !defined(PROFILING)
+  if ( mr_kept )
+    mr_restore();
+#endif
+
+  if ( gc_target_overhead > 0.0 || max_heap_kb )
+    adapt_heap_to_live_ratio(real_begin, gc_now_ns());
   
   lobjs_gc_treshold = (long)(heap_to_live_ratio * (double)lobjs_current);
   
@@ -1642,6 +2971,11 @@ gc(uintptr_t **sp, size_t reg_map)
   // and LARGE OBJECTS -- this clearance is safe because we have 
   // freed only those large objects that are unmarked and thus do
   // not occur in the scan container...
+#ifndef PROFILING
+  if ( gc_threads > 1 )
+    clear_scan_container_par();
+  else
+#endif // PROFILING
   clear_scan_container();
 
 #ifdef CHECK_GC
@@ -1652,8 +2986,8 @@ gc(uintptr_t **sp, size_t reg_map)
 
   // Update the GC treshold for region pages - we add -1.0 to
   // leave room for copying...
-  rp_gc_treshold = (int)((heap_to_live_ratio - 1.0) * (double)rp_total / heap_to_live_ratio);
-  if ( (int)((heap_to_live_ratio - 1.0) * (double)rp_used) > rp_gc_treshold )
+  rp_gc_treshold = (size_t)((heap_to_live_ratio - 1.0) * (double)rp_total / heap_to_live_ratio);
+  if ( (size_t)((heap_to_live_ratio - 1.0) * (double)rp_used) > rp_gc_treshold )
     {      
 #ifdef ENABLE_GEN_GC
       if ( is_minor_p )
@@ -1662,7 +2996,7 @@ gc(uintptr_t **sp, size_t reg_map)
 	{ 
 	  major_p = 0;
 #endif // ENABLE_GEN_GC
-	  rp_gc_treshold = (int)((heap_to_live_ratio - 1.0) * (double)rp_used);
+	  rp_gc_treshold = (size_t)((heap_to_live_ratio - 1.0) * (double)rp_used);
 #ifdef ENABLE_GEN_GC
 	}
 #endif // ENABLE_GEN_GC
@@ -1680,6 +3014,21 @@ gc(uintptr_t **sp, size_t reg_map)
   // callSbrkArg((int)to_allocate + REGION_PAGE_BAG_SIZE);
   // }
 
+  real_end = gc_now_ns();
+  if ( verbose_gc || report_gc || gc_log )
+    gc_record_pause(real_end - real_begin);
+  if ( gc_log )
+    gc_log_event(
+#ifdef ENABLE_GEN_GC
+		 !minor_gc,
+#else
+		 1,
+#endif
+		 trigger, real_begin, real_end, from_space_pages,
+		 (size_t)rp_used - (pages_before - from_space_pages), (size_t)rp_used,
+		 lobjs_before, lobjs_current);
+  gc_trigger = GC_TRIGGER_HEAP;
+
   if ( verbose_gc || report_gc ) 
     {
       getrusage(RUSAGE_SELF, &rusage_end);
@@ -1691,11 +3040,17 @@ gc(uintptr_t **sp, size_t reg_map)
       time_gc_all_ms += time_gc_one_ms;
     }
 
+#ifdef ENABLE_GEN_GC
+  if ( gc_max_pause_us && minor_gc )
+    adjust_young_limit((long)((real_end - real_begin) / 1000));
+  rp_young = 0;
+#endif // ENABLE_GEN_GC
+
   if ( verbose_gc ) 
     {
       double RI = 0.0, GC = 0.0, FRAG = 0.0;
-      unsigned long bytes_to_space;
-      unsigned long pages_to_space;
+      size_t bytes_to_space;
+      size_t pages_to_space;
 
       bytes_to_space = allocated_bytes_in_regions(); // ok gengc
       pages_to_space = allocated_pages_in_regions(); // ok gengc
@@ -1705,11 +3060,17 @@ gc(uintptr_t **sp, size_t reg_map)
       alloc_total += lobjs_period;                 // ok gengc
       gc_total += (bytes_from_space + lobjs_beforegc - bytes_to_space - lobjs_aftergc);
 
-      fprintf(stderr,"(%ldms)", time_gc_one_ms);
+      if ( gc_threads > 1 )
+	{
+	  fprintf(stderr,"(%ldms, %ldms real)", time_gc_one_ms,
+		  (long)((real_end - real_begin) / 1000000));
+	}
+      else
+	fprintf(stderr,"(%ldms)", time_gc_one_ms);
       /*
-      fprintf(stderr, " rp_total: %d\n", rp_total);
-      fprintf(stderr, " size_scan_stack: %d\n", (size_scan_stack*4) / 1024);
-      fprintf(stderr, " size_scan_container: %d\n", (size_scan_container*4) / 1024);
+      fprintf(stderr, " rp_total: %ld\n", rp_total);
+      fprintf(stderr, " size_scan_stack: %d\n", (size_scan_stack*sizeof(void *)) / 1024);
+      fprintf(stderr, " size_scan_container: %d\n", (size_scan_container*sizeof(void *)) / 1024);
       fprintf(stderr, " to_space_old: %d\n", to_space_old);
       fprintf(stderr, " alloc_period: %d\n", alloc_period);
       fprintf(stderr, " alloc_period_save: %d\n", alloc_period_save);
@@ -1733,19 +3094,19 @@ gc(uintptr_t **sp, size_t reg_map)
 				   bytes_to_space - lobjs_aftergc)));
 
 	  FRAG = 100.0 - 100.0 * (((double)(bytes_from_space + lobjs_beforegc)) / 
-				  ((double)(4*ALLOCATABLE_WORDS_IN_REGION_PAGE*pages_from_space 
+				  ((double)((sizeof(void *))*ALLOCATABLE_WORDS_IN_REGION_PAGE*pages_from_space 
 					    + lobjs_beforegc)));
 	  FRAG_sum = FRAG_sum + FRAG;
 	}
 
-      fprintf(stderr,"%ldkb(%2.0f%%)+L%zdkb -> %ldkb(%2.0f%%)+L%zdkb, FL:%zdkb, ",
-	      pages_from_space,
+      fprintf(stderr,"%zukb(%2.0f%%)+L%zdkb -> %zukb(%2.0f%%)+L%zdkb, FL:%zdkb, ",
+	      pages_to_kb(pages_from_space),
 	      region_utilize(pages_from_space, bytes_from_space),
 	      lobjs_beforegc / 1024,
-	      pages_to_space,
+	      pages_to_kb(pages_to_space),
 	      region_utilize(pages_to_space, bytes_to_space),	      
 	      lobjs_aftergc / 1024,
-	      size_free_list());
+	      pages_to_kb(size_free_list()));
       fprintf(stderr, "RI:%2.0f%%, GC:%2.0f%%]\n",
 	      RI, GC);	     
       
@@ -1759,9 +3120,9 @@ gc(uintptr_t **sp, size_t reg_map)
   doing_gc = 0; // Mutex on the garbage collector
   
   if (raised_exn_interupt) 
-    raise_exn((int)&exn_INTERRUPT);
+    raise_exn((uintptr_t)&exn_INTERRUPT);
   if (raised_exn_overflow)
-    raise_exn((int)&exn_OVERFLOW);
+    raise_exn((uintptr_t)&exn_OVERFLOW);
   return;
 }
 
@@ -22,6 +22,8 @@ extern ssize_t doing_gc;
 #ifdef ENABLE_GEN_GC
 extern ssize_t major_p;
 extern ssize_t num_gc_major;
+extern size_t rp_young;
+extern size_t rp_young_limit;
 #endif
 extern ssize_t num_gc;
 
@@ -30,12 +32,21 @@ extern ssize_t raised_exn_overflow;
 
 extern ssize_t time_gc_all_ms;
 
+// Reasons for setting time_to_gc, recorded in gc_trigger for the
+// events written with -gc_log
+#define GC_TRIGGER_HEAP   0   // rp_used exceeded rp_gc_treshold
+#define GC_TRIGGER_EXTEND 1   // new region pages were obtained from the OS
+#define GC_TRIGGER_LOBJS  2   // lobjs_current exceeded lobjs_gc_treshold
+#define GC_TRIGGER_YOUNG  3   // rp_young exceeded rp_young_limit
+extern size_t gc_trigger;
+
 extern size_t *data_begin_addr;
 extern size_t *data_end_addr;
 
 size_t size_lobj(size_t tag);
 
 void gc(size_t **sp, size_t reg_map);
+void report_gc_pauses(void);
 
 #endif /*ENABLE_GC*/
 
@@ -218,6 +218,7 @@ static Heap* newHeap(serverstate ss)
   if ( h == 0 )
     (*ss->report) (DIE, "newHeap: couldn't allocate room for heap",ss->aux);
   h->status = HSTAT_UNINITIALIZED;
+  h->node = regionPageNode();
   h->r0copy = NULL;
   h->r2copy = NULL;
   h->r3copy = NULL;
@@ -231,12 +232,19 @@ static Heap* newHeap(serverstate ss)
 Heap* getHeap(serverstate ss)
 {
   Heap* h;
+  int i, node = regionPageNode();
 
   LOCK_LOCK(STACKPOOLMUTEX);
   if ( heapPoolIndex )
     {
       // Sound as heapPoolIndex != 0 --> heapPool != NULL
-      h = heapPool[--heapPoolIndex];
+      // Take the most recently released heap of our node, if any
+      for ( i = heapPoolIndex - 1 ; i >= 0 && heapPool[i]->node != node ; i-- )
+	;
+      if ( i < 0 )
+	i = heapPoolIndex - 1;
+      h = heapPool[i];
+      heapPool[i] = heapPool[--heapPoolIndex];
       LOCK_UNLOCK(STACKPOOLMUTEX);
     }
   else   // allocate new heap
@@ -43,6 +43,7 @@ typedef struct regionCopy {
 typedef struct heap {
   size_t heapid;               // unique heap id
   int status;               // heap status
+  int node;                 // page pool (NUMA node) of the thread that created the heap
   RegionCopy *r0copy;       // rtype top
   RegionCopy *r2copy;       // rtype pair
   RegionCopy *r3copy;       // rtype string
@@ -58,7 +59,9 @@ typedef struct heap {
 } Heap;
 
 // [getHeap()] returns a heap h from the pool of heaps with the status
-// set to either HSTAT_UNINITIALIZED or HSTAT_CLEAN. In the latter
+// set to either HSTAT_UNINITIALIZED or HSTAT_CLEAN. Heaps created by
+// threads on the node of the calling thread are preferred (see 
+// regionPageNode in Region.h). In the latter
 // case, the stack pointer h->sp and the dataspace counter &(h->ds)
 // can be extracted and used for interpretation; all what remains is
 // to interpret the leaf bytecode. In the former case, library code
@@ -234,7 +234,7 @@ stdErrStream(uintptr_t dummy)
 }
 
 void 
-sml_chdir(String dirname, long exn)              /* SML Basis */
+sml_chdir(String dirname, uintptr_t exn)              /* SML Basis */
 {
   if ( chdir(&(dirname->data)) != 0 ) 
     {
@@ -244,7 +244,7 @@ sml_chdir(String dirname, long exn)              /* SML Basis */
 }
 
 void 
-sml_remove(String name, int exn)                /* SML Basis */
+sml_remove(String name, uintptr_t exn)                /* SML Basis */
 {
   int ret;
   ret = unlink(&(name->data));
@@ -256,7 +256,7 @@ sml_remove(String name, int exn)                /* SML Basis */
 }
 
 void 
-sml_rename(String oldname, String newname, int exn)    /* SML Basis */
+sml_rename(String oldname, String newname, uintptr_t exn)    /* SML Basis */
 {
   if ( rename(&(oldname->data), &(newname->data)) != 0 ) 
     {
@@ -266,7 +266,7 @@ sml_rename(String oldname, String newname, int exn)    /* SML Basis */
 }
 
 int 
-sml_access(String path, int permarg, int exn)               /* ML */
+sml_access(String path, int permarg, uintptr_t exn)               /* ML */
 {
   long perms;
   long perm = convertIntToC(permarg);
@@ -285,7 +285,7 @@ sml_access(String path, int permarg, int exn)               /* ML */
 }
 
 String
-REG_POLY_FUN_HDR(sml_getdir, Region rAddr, int exn)                 	 /* SML Basis */
+REG_POLY_FUN_HDR(sml_getdir, Region rAddr, uintptr_t exn)                 	 /* SML Basis */
 {
  char directory[MAXPATHLEN];
  char *res;
@@ -299,7 +299,7 @@ REG_POLY_FUN_HDR(sml_getdir, Region rAddr, int exn)                 	 /* SML Bas
 }
 
 int 
-sml_isdir(String path, int exn)             /* SML Basis */
+sml_isdir(String path, uintptr_t exn)             /* SML Basis */
 {
   struct stat buf;
   if ( stat(&(path->data), &buf) == -1 ) 
@@ -314,7 +314,7 @@ sml_isdir(String path, int exn)             /* SML Basis */
 }
 
 void 
-sml_mkdir(String path, int exn)                        /* SML Basis */
+sml_mkdir(String path, uintptr_t exn)                        /* SML Basis */
 {
   if ( mkdir(&(path->data), 0777) == -1 ) 
     {
@@ -324,8 +324,8 @@ sml_mkdir(String path, int exn)                        /* SML Basis */
 }
 
 
-int 
-sml_modtime(uintptr_t vAddr, String path, int exn)             /* SML Basis */
+uintptr_t 
+sml_modtime(uintptr_t vAddr, String path, uintptr_t exn)             /* SML Basis */
 {
   struct stat buf;
   if ( stat(&(path->data), &buf) == -1 ) 
@@ -338,7 +338,7 @@ sml_modtime(uintptr_t vAddr, String path, int exn)             /* SML Basis */
 }
 
 void 
-sml_rmdir(String path, int exn)              /* SML Basis */
+sml_rmdir(String path, uintptr_t exn)              /* SML Basis */
 {
   if ( rmdir(&(path->data)) == -1 ) 
     {
@@ -348,7 +348,7 @@ sml_rmdir(String path, int exn)              /* SML Basis */
 }
 
 void 
-sml_settime(String path, uintptr_t time, int exn)     /* SML Basis */
+sml_settime(String path, uintptr_t time, uintptr_t exn)     /* SML Basis */
 {
   struct utimbuf tbuf;
   tbuf.actime = tbuf.modtime = (long)(get_d(time));
@@ -359,8 +359,8 @@ sml_settime(String path, uintptr_t time, int exn)     /* SML Basis */
   return;
 }
 
-int 
-sml_filesize(String path, int exn)              /* SML Basis */
+ssize_t 
+sml_filesize(String path, uintptr_t exn)              /* SML Basis */
 {
   struct stat buf;
   if ( stat(&(path->data), &buf) == -1 ) 
@@ -371,7 +371,7 @@ sml_filesize(String path, int exn)              /* SML Basis */
 }
 
 uintptr_t 
-sml_opendir(String path, int exn)           /* SML Basis */
+sml_opendir(String path, uintptr_t exn)           /* SML Basis */
 {
   DIR * dstr;    
   dstr = opendir(&(path->data));
@@ -384,7 +384,7 @@ sml_opendir(String path, int exn)           /* SML Basis */
 }
 
 String
-REG_POLY_FUN_HDR(sml_readdir, Region rAddr, uintptr_t v, int exn)    /* SML Basis */
+REG_POLY_FUN_HDR(sml_readdir, Region rAddr, uintptr_t v, uintptr_t exn)    /* SML Basis */
 {
   struct dirent *direntry;
   String res;
@@ -414,7 +414,7 @@ sml_rewinddir(uintptr_t v)            /* SML Basis */
 }
 
 void 
-sml_closedir(uintptr_t v, int exn)            /* SML Basis */
+sml_closedir(uintptr_t v, uintptr_t exn)            /* SML Basis */
 {
   DIR *dir_ptr;
 
@@ -444,7 +444,7 @@ REG_POLY_FUN_HDR(sml_errormsg, Region rAddr, int errnum)    /* SML Basis */
 }
 
 int 
-sml_islink(String path, int exn)              /* SML Basis */
+sml_islink(String path, uintptr_t exn)              /* SML Basis */
 {
   struct stat buf;
   if (lstat(&(path->data), &buf) == -1) 
@@ -459,7 +459,7 @@ sml_islink(String path, int exn)              /* SML Basis */
 }
 
 int 
-sml_isreg(int fd, int exn)              /* SML Basis */
+sml_isreg(int fd, uintptr_t exn)              /* SML Basis */
 {
   struct stat buf;
   if (fstat(convertIntToC(fd), &buf) == -1) 
@@ -473,8 +473,8 @@ sml_isreg(int fd, int exn)              /* SML Basis */
   return mlFALSE;
 }
 
-int 
-sml_filesizefd(int fd, int exn)              /* SML Basis */
+ssize_t 
+sml_filesizefd(int fd, uintptr_t exn)              /* SML Basis */
 {
   struct stat buf;
   if (fstat(convertIntToC(fd), &buf) == -1) 
@@ -485,7 +485,7 @@ sml_filesizefd(int fd, int exn)              /* SML Basis */
 }
 
 String
-REG_POLY_FUN_HDR(sml_readlink, Region rAddr, String path, int exn)    /* SML Basis */
+REG_POLY_FUN_HDR(sml_readlink, Region rAddr, String path, uintptr_t exn)    /* SML Basis */
 {
   char buffer[MAXPATHLEN];
   long result;
@@ -501,7 +501,7 @@ REG_POLY_FUN_HDR(sml_readlink, Region rAddr, String path, int exn)    /* SML Bas
 extern char *realpath();
 
 String
-REG_POLY_FUN_HDR(sml_realpath, Region rAddr, String path, int exn)  /* SML Basis */
+REG_POLY_FUN_HDR(sml_realpath, Region rAddr, String path, uintptr_t exn)  /* SML Basis */
 {
   char buffer[MAXPATHLEN];
   char *result;
@@ -515,7 +515,7 @@ REG_POLY_FUN_HDR(sml_realpath, Region rAddr, String path, int exn)  /* SML Basis
 }
 
 uintptr_t 
-sml_devinode(uintptr_t vAddr, String path, int exn)             /* SML Basis */
+sml_devinode(uintptr_t vAddr, String path, uintptr_t exn)             /* SML Basis */
 {
   struct stat buf;
   if (stat(&(path->data), &buf) == -1) 
@@ -529,8 +529,8 @@ sml_devinode(uintptr_t vAddr, String path, int exn)             /* SML Basis */
   return vAddr;
 }
 
-int 
-sml_system(String cmd, int exn)         /* SML Basis */
+ssize_t 
+sml_system(String cmd, uintptr_t exn)         /* SML Basis */
 {
   int res;
   res = system(&(cmd->data));
@@ -542,7 +542,7 @@ sml_system(String cmd, int exn)         /* SML Basis */
 }
 
 String
-REG_POLY_FUN_HDR(sml_getenv, Region rAddr, String var, int exn)  /* SML Basis */
+REG_POLY_FUN_HDR(sml_getenv, Region rAddr, String var, uintptr_t exn)  /* SML Basis */
 {
   char *res;
   res = (char *)(getenv(&(var->data)));
@@ -45,8 +45,10 @@ Exception *exn_BIND;       // Initialized in Interp.c
 Exception *exn_DIV;        // Initialized in Interp.c
 Exception *exn_MATCH;      // Initialized in Interp.c
 jmp_buf global_exn_env;    // 
+static uintptr_t raised_exn; // the exception raised by a C function
 void raise_exn(uintptr_t exn) { 
-  longjmp(global_exn_env, (int)exn);   // never returns 
+  raised_exn = exn;          // longjmp only passes an int
+  longjmp(global_exn_env, 1);   // never returns 
 } 
 #endif
 
@@ -63,29 +65,38 @@ printList (uintptr_t l) {    // function to print out a list
 // typedef unsigned char * bytecode_t;
 // bytecode_t start_code;
 
-typedef int int32;
-typedef unsigned int uint32;
-
-#define SHORT  (sizeof(short))
-#define LONG   (sizeof(int32))
-#define DOUBLE (sizeof(double))
-
-#define s32(p) (* (int32 *) (p))
-#define s32_1(p) (* (int32 *) (p+4))
-#define s32_2(p) (* (int32 *) (p+8))
-#define u32_1(p) (* (uint32 *) (p+4))
-#define u32_2(p) (* (uint32 *) (p+8))
-#define u32(p) (* (uint32 *) (p))
-
-#define u8pc  (unsigned char)(*pc)
-#define s32pc s32(pc)
-#define s32_1pc s32_1(pc)
-#define s32_2pc s32_2(pc)
-#define u32pc u32(pc)
-#define u32_1pc u32_1(pc)
-#define u32_2pc u32_2(pc)
-#define inc32pc pc += 4
-#define inc2_32pc pc += 8
+typedef int32_t int32;
+typedef uint32_t uint32;
+
+/* Loaded code is a sequence of words: LoadKAM widens each 32-bit unit
+ * of the bytecode file to a word, so that instructions, immediates and
+ * patched addresses all take up one word on any host; pc is advanced
+ * a word at a time and jump offsets count words. */
+#define WORD (sizeof(uintptr_t))
+
+#define sw(p) (* (ssize_t *) (p))
+#define sw_1(p) (* (ssize_t *) ((p)+WORD))
+#define sw_2(p) (* (ssize_t *) ((p)+2*WORD))
+#define uw_1(p) (* (uintptr_t *) ((p)+WORD))
+#define uw_2(p) (* (uintptr_t *) ((p)+2*WORD))
+#define uw(p) (* (uintptr_t *) (p))
+
+#define swpc sw(pc)
+#define sw_1pc sw_1(pc)
+#define sw_2pc sw_2(pc)
+#define uwpc uw(pc)
+#define uw_1pc uw_1(pc)
+#define uw_2pc uw_2(pc)
+#define incwpc pc += WORD
+#define inc2_wpc pc += 2*WORD
+
+/* ML integers and words are 32 bits on all hosts (see
+ * BackendInfo.defaultIntPrecision). On a 64-bit host they are kept
+ * sign-extended, which is how LoadKAM widens immediates; arithmetic
+ * is done on int32 and uint32 and the results are sign-extended with
+ * ofInt32, so that programs behave the same on 32-bit and 64-bit
+ * hosts. */
+#define ofInt32(i) ((ssize_t)(int32)(i))
 
 #define Raise(EXNVALUE) {                                                                 \
  	debug(printf("RAISE; EXNVALUE = %x\n", EXNVALUE));                                \
@@ -99,32 +110,62 @@ typedef unsigned int uint32;
                                                         /* now do the function call! The  \ 
 						         * closure and the return address \
 							 * are on the stack... */         \
-	env = (int *) selectStackDef(0);                /* one argument */                \
+	env = (uintptr_t *) selectStackDef(0);                /* one argument */                \
 	debug(printf("Writing to sp = 0x%x\n", sp -1));                                   \
 	pushDef(EXNVALUE);                                                                \
 	pc = (bytecode_t) *env;                                                           \
 }
 
-// FIXME setjmp and longjmp only handles integers. Thus an exception map is needed.
+// setjmp and longjmp only handle integers; raise_exn leaves the
+// exception value in raised_exn.
 
-#define Setup_for_c_call  int return_value; \
-                          if( (return_value = setjmp(global_exn_env)) == 0 ) {
+#define Setup_for_c_call  if( setjmp(global_exn_env) == 0 ) {
 
                          
 #define Restore_after_c_call  } else { \
                                 debug(printf("\n***Exception raised***\n")); \
-                                acc = return_value; \
+                                acc = raised_exn; \
                                 goto raise_exception; \
                               }
 
-#define JUMPTGT(offset) (bytecode_t)(pc + offset)
-#define branch() pc = JUMPTGT(s32pc)
+/* Top-of-stack caching. When compiled with KAM_CACHE_TOS, the
+ * interpreter keeps a copy of the top stack slot in the register tos,
+ * so that popping a value does not wait for a load from memory; the
+ * slot below is loaded into tos when the value is popped, which is off
+ * the critical path. The cache is write-through: pushes also store in
+ * the stack, which therefore stays valid for the code that reads the
+ * stack through pointers (exception handlers, region descriptors and
+ * finite regions, the heap cache). Values below sp0 are always valid
+ * stack slots, as the global exception handler is pushed before the
+ * interpreter is entered. Slots written through pointers while on top
+ * of the stack (finite regions and region descriptors) may leave tos
+ * stale, but such slots are never popped as values. */
+#ifdef KAM_CACHE_TOS
+#undef popValDef
+#undef popNDef
+#undef pushDef
+#undef offsetSP
+#define popValDef (tos_popped = tos, tos = *(--sp - 1), tos_popped)
+#define popNDef(N) { sp -= (N); tos = *(sp - 1); }
+#define pushDef(Arg) { tos = (Arg); *sp = tos; sp += 1; }
+#define offsetSP(N) { sp += (N); tos = *(sp - 1); }
+#define selectStackTop tos
+#else
+#define selectStackTop selectStackDef(-1)
+#endif
+
+#define JUMPTGT(offset) (bytecode_t)(pc + (offset)*WORD)
+#define branch() pc = JUMPTGT(swpc)
 
 #ifdef LAB_THREADED
 #define Instruct(name) lbl_##name
-// #define Next { temp = (int)pc; inc32pc; if ((inst_count++ % 1000) == 0) debug_writer5 ("INST %d, %d, env 0x%x, *env 0x%x --- **(ds + 0x5fb) = 0x%x\n", inst_count, getInstNumber(jumptable, jumptableSize, *(void **) temp), (int) env, (uint) env > 100 ? *env : 0, debug_file != -1 ? *((unsigned long *)*(ds + 0x5fb)) : 0); goto **(void **)temp; }
-// #define Next { temp = (int)pc; inc32pc; inst_count++; /*if ((inst_count % 1) == 0)*/ debug_writer2 ("INST %d, %d %x\n", inst_count, getInstNumber(jumptable, jumptableSize, *(void **) temp)); checkCaches(serverCtx->aux); goto **(void **)temp; }
-#define Next { temp = (uintptr_t)pc; inc32pc;  goto **(void **)temp; }
+// #define Next { temp = (int)pc; incwpc; if ((inst_count++ % 1000) == 0) debug_writer5 ("INST %d, %d, env 0x%x, *env 0x%x --- **(ds + 0x5fb) = 0x%x\n", inst_count, getInstNumber(jumptable, jumptableSize, *(void **) temp), (ssize_t) env, (uint) env > 100 ? *env : 0, debug_file != -1 ? *((unsigned long *)*(ds + 0x5fb)) : 0); goto **(void **)temp; }
+// #define Next { temp = (int)pc; incwpc; inst_count++; /*if ((inst_count % 1) == 0)*/ debug_writer2 ("INST %d, %d %x\n", inst_count, getInstNumber(jumptable, jumptableSize, *(void **) temp)); checkCaches(serverCtx->aux); goto **(void **)temp; }
+#ifdef KAM_PROFILE_PAIRS
+#define Next { temp = (uintptr_t)pc; incwpc; profile_pair(*(void **)temp); goto **(void **)temp; }
+#else
+#define Next { temp = (uintptr_t)pc; incwpc;  goto **(void **)temp; }
+#endif
 #else
 #define Instruct(name) case name
 #define Next break
@@ -158,7 +199,7 @@ typedef unsigned int uint32;
 
 #define primwbinop(name,msg,bop)            \
   Instruct(name): {                           \
-    acc = ((unsigned long)(popValDef)) bop ((unsigned long)acc);  \
+    acc = ofInt32(((uint32)(popValDef)) bop ((uint32)acc));  \
     debug(printf("%s gives %x\n", msg,acc));  \
     Next;                                     \
   }
@@ -186,9 +227,9 @@ typedef unsigned int uint32;
 
 #define primwtest(name,msg,tst)	                      \
     Instruct(name): {		                      \
-      unsigned long t1, t2;                           \
-      t1 = (unsigned long)popValDef;                  \
-      t2 = (unsigned long)acc;                        \
+      uint32 t1, t2;                                  \
+      t1 = (uint32)popValDef;                         \
+      t2 = (uint32)acc;                               \
       if ((t1) tst (t2))                              \
         acc = mlTRUE;                                 \
       else                                            \
@@ -200,7 +241,7 @@ typedef unsigned int uint32;
 /* the following doesn't work with gcc 2.96 under Redhat 7.0 ...
 #define primwtest(name,msg,tst)	                      \
     Instruct(name): {		                      \
-      if (((unsigned long)popValDef) tst ((unsigned long)acc))  \
+      if (((uint32)popValDef) tst ((uint32)acc))  \
         acc = mlTRUE;                                 \
       else                                            \
         acc = mlFALSE;                                \
@@ -217,71 +258,88 @@ typedef unsigned int uint32;
      if (((int)selectStackDef(-1)) tst ((int)acc))    \
        branch();                                \
      else                                       \
-       inc32pc;                                 \
+       incwpc;                                 \
      debug(printf("%s %d and %d\n", msg,selectStackDef(-1),acc));     \
 	Next;                                   \
    }
 */
 
+/* Comparison followed by the test of a boolean switch; jumps if the
+ * comparison is false. The boolean is left in acc for the code at
+ * the jump target. */
+#define ifnotintjmp(name, msg, tst)                   \
+    Instruct(name): {		                      \
+      if (((int)popValDef) tst ((int)acc)) {          \
+        acc = mlTRUE;                                 \
+        incwpc;                                      \
+      } else {                                        \
+        acc = mlFALSE;                                \
+        branch();                                     \
+      }                                               \
+      debug(printf("%s gives acc = %d\n", msg, acc)); \
+      Next;                                           \
+    }
+
 #define iftestimmed(name, msg, tst)             \
    Instruct(name): {                            \
-     debug(printf("%s %d and %d\n",msg,acc,s32_1pc));  \
-     if (((int)acc) tst ((int)s32_1pc))         \
+     debug(printf("%s %d and %d\n",msg,acc,sw_1pc));  \
+     if (((int)acc) tst ((int)sw_1pc))         \
        branch();                                \
      else {                                     \
-       inc32pc;                                 \
-       inc32pc;                                 \
+       incwpc;                                 \
+       incwpc;                                 \
      }                                          \
      Next;                                      \
    }
 
 #define allocN {                 \
-  debug(printf("allocN %d\n", s32pc)); \
-  acc = (int) alloc((Region)acc, s32pc); \
+  debug(printf("allocN %d\n", swpc)); \
+  acc = (ssize_t) allocInline((Region)acc, swpc); \
 }
 
 #define allocIfInfN {              \
-  debug(printf("allocIfInfN %d acc = 0x%x\n", s32pc, acc)); \
+  debug(printf("allocIfInfN %d acc = 0x%x\n", swpc, acc)); \
   if (is_inf(acc)) {                 \
     debug(printf("  allocating\n")); \
-    acc = (int) alloc((Region)acc, s32pc);   \
+    acc = (ssize_t) allocInline((Region)acc, swpc);   \
   }                                  \
 }
 
 #define allocSatInfN {           \
-  debug(printf("allocSatInfN %d\n", s32pc)); \
+  debug(printf("allocSatInfN %d\n", swpc)); \
   if (is_atbot((Region)acc))             \
     resetRegion((Region)acc);            \
-  acc = (int) alloc((Region)acc, s32pc); \
+  acc = (ssize_t) allocInline((Region)acc, swpc); \
 }
 
 #define allocSatIfInfN {            \
-  debug(printf("allocSatIfInfN %d acc = 0x%x\n", s32pc,acc)); \
+  debug(printf("allocSatIfInfN %d acc = 0x%x\n", swpc,acc)); \
   if (is_inf_and_atbot((Region)acc)) {       \
     resetRegion((Region)acc);               \
     debug(printf("  resetting\n")); \
   }                                 \
   if (is_inf((Region)acc)) {                \
     debug(printf("  allocating\n")); \
-    acc = (int) alloc((Region)acc, s32pc);  \
+    acc = (ssize_t) allocInline((Region)acc, swpc);  \
   }                                 \
 }
 
 #define allocAtbotN {            \
-  debug(printf("allocAtbotN %d\n", s32pc)); \
+  debug(printf("allocAtbotN %d\n", swpc)); \
   resetRegion((Region)acc);              \
-  acc = (int) alloc((Region)acc, s32pc); \
+  acc = (ssize_t) allocInline((Region)acc, swpc); \
 }
 
 #define blockCopy2 { \
-  *((int *)acc + 1) = popValDef; \
-  *((int *)acc) = popValDef; \
+  *((uintptr_t *)acc + 1) = popValDef; \
+  *((uintptr_t *)acc) = popValDef; \
 }  
 
 #define blockCopyN {                  \
-  debug(printf("blockCopyN %d at %x\n", s32pc,acc)); \
-  for (temp=s32pc-1;temp>=0;temp--)   \
-    *(((int *)acc)+temp) = popValDef; \
+  debug(printf("blockCopyN %d at %x\n", swpc,acc)); \
+  popNDef(swpc);                     \
+  for (temp=0;temp<swpc;temp++)      \
+    *(((uintptr_t *)acc)+temp) = selectStackDef(temp); \
 }
 
 
@@ -320,14 +378,14 @@ void
 resolveInstructions(int sizeW, bytecode_t start_code,
                     void * jumptable [], unsigned int jumptableSize,
                     void *ccalltable[]) {
-  unsigned long *real_code;
+  uintptr_t *real_code;
   int tmp, tmp2;
   int j, i = 0;
-  real_code = (unsigned long*)start_code;
+  real_code = (uintptr_t*)start_code;
 
   while ( i < sizeW ) {
     int arity;
-    unsigned long inst;
+    uintptr_t inst;
     inst = *(real_code + i);
     arity = getInstArity(inst);
     if ( arity == -100 )
@@ -338,7 +396,7 @@ resolveInstructions(int sizeW, bytecode_t start_code,
       // This is needed to let apache restart without trouble
       for (j = 0; j < jumptableSize; j++)
       {
-        if (((unsigned long) jumptable[j]) == inst)
+        if (((uintptr_t) jumptable[j]) == inst)
         {
           return;
         }
@@ -351,7 +409,7 @@ resolveInstructions(int sizeW, bytecode_t start_code,
       printf ("sizeW = %d, i= %d, inst = %ld\n", sizeW, i, inst);
       die ("resolveInstructions: Hmm - inst number > 1000");
     }
-    *(real_code + i) = (unsigned long)(jumptable[inst]);
+    *(real_code + i) = (uintptr_t)(jumptable[inst]);
     for (tmp = 0, tmp2 = 0; tmp < 7; tmp++)
     {
       if (jumptable[inst] == ccalltable[tmp]) tmp2 = 1;
@@ -362,7 +420,7 @@ resolveInstructions(int sizeW, bytecode_t start_code,
       if (inst != 0) // Static Ccall
       {
         //printf("converting %d to %x\n", inst, cprim[inst-1]);
-        real_code[i+1] = (unsigned long) cprim[inst-1];
+        real_code[i+1] = (uintptr_t) cprim[inst-1];
       }
     }
     switch (arity) {  /* IMMED_STRING -- compute arity... */
@@ -373,7 +431,7 @@ resolveInstructions(int sizeW, bytecode_t start_code,
 	str_size_bytes += 1;            // zero-termination
 	if (str_size_bytes % 4 != 0)
 	  str_size_bytes += (4 - (str_size_bytes % 4));
-	str_size = str_size_bytes / 4;	
+	str_size = str_size_bytes / 4;  // a word for each unit of the file
 	arity = str_size + 1;   /*tag*/
 	break;
       } 
@@ -399,6 +457,109 @@ resolveInstructions(int sizeW, bytecode_t start_code,
   }
 }
 
+#ifdef KAM_PROFILE_PAIRS
+#ifndef LAB_THREADED
+#error "KAM_PROFILE_PAIRS requires LAB_THREADED"
+#endif
+
+/* Instruction-pair profiling. The counters are indexed by instruction
+ * numbers; the executed code holds instruction addresses, which are
+ * mapped back to instruction numbers with a small hash table. The
+ * counters are not protected by locks, so profile a single-threaded
+ * program. The hottest pairs are the candidates for superinstructions
+ * in KamInsts.spec (see the peephole functions in CodeGenKAM.sml). */
+
+#define PAIR_HASH_SIZE 1024     /* power of two, larger than the number of instructions */
+#define pair_hash(addr) ((((uintptr_t)(addr)) >> 2) & (PAIR_HASH_SIZE - 1))
+
+static void *pair_hash_addr[PAIR_HASH_SIZE];
+static unsigned int pair_hash_inst[PAIR_HASH_SIZE];
+static unsigned long *pair_counts = NULL;
+static size_t pair_insts = 0;
+static long pair_prev = -1;
+
+typedef struct {
+  unsigned long count;
+  unsigned int first;
+  unsigned int second;
+} PairCount;
+
+static int
+cmpPairCount(const void *a, const void *b)
+{
+  unsigned long ca = ((const PairCount *)a)->count;
+  unsigned long cb = ((const PairCount *)b)->count;
+  return (ca < cb) - (ca > cb);   // most frequent first
+}
+
+static void
+profile_pairs_dump(void)
+{
+  PairCount *ps;
+  size_t i, j, n = 0;
+  FILE *f;
+
+  ps = (PairCount *)malloc(pair_insts * pair_insts * sizeof(PairCount));
+  if ( ps == NULL )
+    return;
+  for ( i = 0; i < pair_insts; i++ )
+    for ( j = 0; j < pair_insts; j++ )
+      if ( pair_counts[i * pair_insts + j] ) {
+	ps[n].count = pair_counts[i * pair_insts + j];
+	ps[n].first = i;
+	ps[n].second = j;
+	n++;
+      }
+  qsort(ps, n, sizeof(PairCount), cmpPairCount);
+  if ( (f = fopen(KAM_PROFILE_PAIRS_FILE, "w")) == NULL ) {
+    fprintf(stderr, "Cannot open %s for writing\n", KAM_PROFILE_PAIRS_FILE);
+    free(ps);
+    return;
+  }
+  for ( i = 0; i < n; i++ )
+    fprintf(f, "%14lu %s %s\n", ps[i].count,
+	    getInstName(ps[i].first), getInstName(ps[i].second));
+  fclose(f);
+  free(ps);
+}
+
+static void
+profile_pairs_init(void *jumptable[], size_t jumptableSize)
+{
+  size_t i, h;
+
+  pair_prev = -1;
+  if ( pair_counts )
+    return;
+  pair_insts = jumptableSize;
+  pair_counts = (unsigned long *)calloc(jumptableSize * jumptableSize, sizeof(unsigned long));
+  if ( pair_counts == NULL )
+    die("profile_pairs_init: out of memory");
+  for ( i = 0; i < jumptableSize; i++ ) {
+    // LABEL and DOT_LABEL share an address; the first entry is kept
+    for ( h = pair_hash(jumptable[i]); pair_hash_addr[h]; h = (h + 1) & (PAIR_HASH_SIZE - 1) )
+      if ( pair_hash_addr[h] == jumptable[i] )
+	break;
+    if ( pair_hash_addr[h] == NULL ) {
+      pair_hash_addr[h] = jumptable[i];
+      pair_hash_inst[h] = i;
+    }
+  }
+  atexit(profile_pairs_dump);
+}
+
+static inline void
+profile_pair(void *addr)
+{
+  size_t h = pair_hash(addr);
+  while ( pair_hash_addr[h] != addr )
+    h = (h + 1) & (PAIR_HASH_SIZE - 1);
+  if ( pair_prev >= 0 )
+    pair_counts[pair_prev * pair_insts + pair_hash_inst[h]]++;
+  pair_prev = pair_hash_inst[h];
+}
+#endif /*KAM_PROFILE_PAIRS*/
+
 enum interp_mode {
   RESOLVEINSTS,
   INTERPRET
@@ -427,6 +588,10 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 */
 
   register ssize_t acc;
+#ifdef KAM_CACHE_TOS
+  register uintptr_t tos;   // copy of the top stack slot
+  uintptr_t tos_popped;
+#endif
   
 #if defined(__GNUC__) && defined(i386)
   register bytecode_t pc asm("%esi");
@@ -437,8 +602,8 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 #endif
 
   bytecode_t pc_temp;
-  int *env = NULL;
-  uint32 cur_instr = 0;
+  uintptr_t *env = NULL;
+  uintptr_t cur_instr = 0;
   ssize_t temp;
   ssize_t *tmp2;
   //  c_primitive primtmp;
@@ -465,6 +630,10 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
   acc = convertIntToML(0);
   pc = b_prog;
   sp = sp0;
+#ifdef KAM_CACHE_TOS
+  if ( interp_mode == INTERPRET )
+    tos = *(sp - 1);
+#endif
 
   debug(printf("Entering interp\n"));
 
@@ -477,81 +646,84 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
   }
 
 #ifdef LAB_THREADED
+#ifdef KAM_PROFILE_PAIRS
+  profile_pairs_init(jumptable, jumptableSize);
+#endif
   debug_writer1("interp %d Jump to FIRST INSTRUCTION\n",0);
   debug_file_as(unsigned long inst_count,0);
   Next;                 // jump to first instruction
 #else
   while (1) {
     debug(if ( (unsigned long)pc < 10000 ) printf("*** LOW PC ***\n") );
-    cur_instr = u32pc;
+    cur_instr = uwpc;
     debug(printf("0x%x: ", pc));
-    inc32pc;
+    incwpc;
     switch (cur_instr) {
 #endif /*LAB_THREADED*/
 
       Instruct(ALLOC_N): {
 	allocN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(ALLOC_IF_INF_N): {
 	allocIfInfN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(ALLOC_SAT_INF_N): {
 	allocSatInfN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(ALLOC_SAT_IF_INF_N): {
 	allocSatIfInfN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(ALLOC_ATBOT_N): {
 	allocAtbotN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(BLOCK_ALLOC_2): {
-	acc = (int) alloc((Region)acc, 2);
+	acc = (ssize_t) allocInline((Region)acc, 2);
 	blockCopy2;
 	Next;
       }
       Instruct(BLOCK_ALLOC_N): {
 	allocN;
 	blockCopyN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(BLOCK_ALLOC_IF_INF_N): {
 	allocIfInfN;
 	blockCopyN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(BLOCK_ALLOC_SAT_INF_N): {
 	allocSatInfN;
 	blockCopyN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(BLOCK_N): {
 	blockCopyN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(BLOCK_ALLOC_SAT_IF_INF_N): {
 	allocSatIfInfN;
 	blockCopyN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(BLOCK_ALLOC_ATBOT_N): {
 	allocAtbotN;
 	blockCopyN;
-	inc32pc;
+	incwpc;
 	Next;
       }
       Instruct(CLEAR_ATBOT_BIT): {
@@ -574,7 +746,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 
       Instruct(CLEAR_BIT_30_AND_31): {
 	debug(printf("clearBitStatusBits\n"));
-	acc = (int)clearStatusBits((Region)acc);
+	acc = (ssize_t)clearStatusBits((Region)acc);
 	Next;
       }
 
@@ -584,10 +756,10 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 	Next;
       }
       Instruct(PUSH_LBL): {
-	debug(printf("PUSH_LBL: %x\n", JUMPTGT(s32pc)));
-  debug_writer2 ("PUSH_LBL pc = 0x%x - *pc = 0x%x\n", (int) pc, (int) s32pc);
-	pushDef((int) JUMPTGT(s32pc));
-	inc32pc;
+	debug(printf("PUSH_LBL: %x\n", JUMPTGT(swpc)));
+  debug_writer2 ("PUSH_LBL pc = 0x%x - *pc = 0x%x\n", (ssize_t) pc, (ssize_t) swpc);
+	pushDef((ssize_t) JUMPTGT(swpc));
+	incwpc;
 	Next;
       }
 
@@ -595,90 +767,90 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(POP_2): { popNDef(2); Next; }
 
       Instruct(POP_N): {
-	popNDef(s32pc);
-	debug(printf("POP_N(%d) - sp = 0x%x\n",s32pc, sp));
-	inc32pc;
+	popNDef(swpc);
+	debug(printf("POP_N(%d) - sp = 0x%x\n",swpc, sp));
+	incwpc;
 	Next;
       }
 
       Instruct(APPLY_FN_CALL): {   /*mael: ok*/
-	debug(printf("APPLY_FN_CALL(acc %d, num args %d, return address %x on stack address %x)\n",acc,s32pc,selectStackDef(-s32pc-1), sp-s32pc-1));
-	temp = (int) env;
-	env = (int *) selectStackDef(-s32pc);
-	selectStackDef(-s32pc) = temp;
-	debug(printf("Writing to sp = 0x%x\n", sp -s32pc));
+	debug(printf("APPLY_FN_CALL(acc %d, num args %d, return address %x on stack address %x)\n",acc,swpc,selectStackDef(-swpc-1), sp-swpc-1));
+	temp = (ssize_t) env;
+	env = (uintptr_t *) selectStackDef(-swpc);
+	selectStackDef(-swpc) = temp;
+	debug(printf("Writing to sp = 0x%x\n", sp -swpc));
 	pushDef(acc);
 	pc = (bytecode_t) *env;
 	Next;
       }
       Instruct(APPLY_FN_JMP): {   /*mael: ok*/
-	debug(printf("APPLY_FN_JMP(acc %d, num args = %d, num rets = %d)\n",acc,s32pc,s32_1pc));
-	env = (int *) selectStackDef(-s32pc);
-	for (temp=0;temp<s32pc-1;temp++) {
-	  selectStackDef(-s32pc-s32_1pc+temp) = selectStackDef(-s32pc+1+temp);
-	  debug(printf("Writing to sp = 0x%x\n", sp -s32pc-s32_1pc+temp));
+	debug(printf("APPLY_FN_JMP(acc %d, num args = %d, num rets = %d)\n",acc,swpc,sw_1pc));
+	env = (uintptr_t *) selectStackDef(-swpc);
+	for (temp=0;temp<swpc-1;temp++) {
+	  selectStackDef(-swpc-sw_1pc+temp) = selectStackDef(-swpc+1+temp);
+	  debug(printf("Writing to sp = 0x%x\n", sp -swpc-sw_1pc+temp));
 	}
-	popNDef(s32_1pc+1);	
+	popNDef(sw_1pc+1);	
 	pushDef(acc);
 	pc = (bytecode_t) *env;
 	Next;
       }
       Instruct(APPLY_FUN_CALL1): {  /*mael: ok*/
-  debug_writer3("APPLY_FUN_CALL1 - env = 0x%x - stack[-1] = 0x%x - acc = 0x%x\n", (int) env, (int) selectStackDef(-1), acc);
-	temp = (int) env;
-	env = (int *) selectStackDef(-1);
+  debug_writer3("APPLY_FUN_CALL1 - env = 0x%x - stack[-1] = 0x%x - acc = 0x%x\n", (ssize_t) env, (ssize_t) selectStackDef(-1), acc);
+	temp = (ssize_t) env;
+	env = (uintptr_t *) selectStackDef(-1);
 	selectStackDef(-1) = temp;
 	pushDef(acc);
 	branch();
 	Next;
       }
       Instruct(APPLY_FUN_CALL2): {  /*mael: ok*/
-	temp = (int) env;
-	env = (int *) selectStackDef(-2);
+	temp = (ssize_t) env;
+	env = (uintptr_t *) selectStackDef(-2);
 	selectStackDef(-2) = temp;
 	pushDef(acc);
 	branch();
 	Next;
       }
       Instruct(APPLY_FUN_CALL3): {  /*mael: ok*/
-	temp = (int) env;
-	env = (int *) selectStackDef(-3);
+	temp = (ssize_t) env;
+	env = (uintptr_t *) selectStackDef(-3);
 	selectStackDef(-3) = temp;
 	pushDef(acc);
 	branch();
 	Next;
       }
       Instruct(APPLY_FUN_CALL): {  /*mael: ok*/
-	debug(printf("APPLY_FUN_CALL with first arg %d and target rel. addr %d and num args \n", acc, s32pc, s32_1pc));
-	temp = (int) env;
-	env = (int *) selectStackDef(-s32_1pc);
-	selectStackDef(-s32_1pc) = temp;
-	debug(printf("Writing to sp = 0x%x\n", sp -s32_1pc));
+	debug(printf("APPLY_FUN_CALL with first arg %d and target rel. addr %d and num args \n", acc, swpc, sw_1pc));
+	temp = (ssize_t) env;
+	env = (uintptr_t *) selectStackDef(-sw_1pc);
+	selectStackDef(-sw_1pc) = temp;
+	debug(printf("Writing to sp = 0x%x\n", sp -sw_1pc));
 	pushDef(acc);
 	branch();
 	Next;
       }
       Instruct(APPLY_FUN_JMP): {   /*mael: ok*/
-	debug(printf("APPLY_FUN_JMP(%d,%d,%d)\n",s32pc,s32_1pc,s32_2pc));
-	env = (int *) selectStackDef(-s32_1pc);
-	for (temp=0;temp<s32_1pc-1;temp++) {
-	  selectStackDef(-s32_1pc-s32_2pc+temp) = selectStackDef(-s32_1pc+1+temp);
-	  debug(printf("Writing to sp = 0x%x\n", sp -s32_1pc-s32_2pc+temp));
+	debug(printf("APPLY_FUN_JMP(%d,%d,%d)\n",swpc,sw_1pc,sw_2pc));
+	env = (uintptr_t *) selectStackDef(-sw_1pc);
+	for (temp=0;temp<sw_1pc-1;temp++) {
+	  selectStackDef(-sw_1pc-sw_2pc+temp) = selectStackDef(-sw_1pc+1+temp);
+	  debug(printf("Writing to sp = 0x%x\n", sp -sw_1pc-sw_2pc+temp));
 	}
-	popNDef(s32_2pc+1);	
+	popNDef(sw_2pc+1);	
 	pushDef(acc);
 	branch();
 	Next;
       }
       Instruct(LETREGION_FIN): {
-	debug(printf("LETREGION_FIN %d at %x\n", u32pc, (int)sp));
-	offsetSP(u32pc);
-	inc32pc;
+	debug(printf("LETREGION_FIN %d at %x\n", uwpc, (ssize_t)sp));
+	offsetSP(uwpc);
+	incwpc;
 	Next;
       }
       Instruct(LETREGION_INF): {
-	debug(printf("LETREGION_INF desc at 0x%x, region at 0x%x\n",(int)sp,acc));
-	acc = (int) allocateRegion((Ro*) sp, topRegionCell);
+	debug(printf("LETREGION_INF desc at 0x%x, region at 0x%x\n",(ssize_t)sp,acc));
+	acc = (ssize_t) allocateRegion((Ro*) sp, topRegionCell);
 	offsetSP(sizeRo);
 	Next;
       }
@@ -712,32 +884,31 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(IMMED_INT3): { acc = 3; Next; }
 
       Instruct(IMMED_INT): {
-	acc = s32pc;
-	inc32pc;
+	acc = swpc;
+	incwpc;
 	debug(printf("IMMED_INT: %d\n", acc));
 	Next;
       }
 
       Instruct(IMMED_REAL): {
-	acc = (unsigned long)pc;
-	inc32pc;
-	inc32pc;
+	acc = (ssize_t)pc;
+	inc2_wpc;
 	debug(printf("IMMED_REAL(%f): acc=%d\n", *(double*)acc, acc));
 	Next;
       }
 
       Instruct(IMMED_STRING): {
-	acc = (int) pc; 
-	temp = get_string_size(s32pc) + 1;  // zero-termination
+	acc = (ssize_t) pc; 
+	temp = get_string_size(uwpc) + 1;  // zero-termination
 	if (temp % 4 != 0) 
 	  temp += (4 - (temp % 4));
-	pc += (temp + 4);
+	pc += (temp / 4 + 1) * WORD;       // a word for each unit of the file
 	debug(printf("IMMED STRING with aligned size %d and acc %d\n", temp, acc));
 	Next;
       }
 
       Instruct(PRIM_NEG_I): {
-	if ( acc == -2147483647 - 1)
+	if ( acc == INT32_MIN)
 	  goto raise_overflow;
 	acc = -acc;
 	debug(printf("PRIM_NEG_I gives %d\n", acc));
@@ -745,26 +916,26 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 /*
     raise_bind:
-      acc = (int)&exn_BIND;
+      acc = (ssize_t)&exn_BIND;
       goto raise_exception;
     raise_match:
-      acc = (int)&exn_MATCH;
+      acc = (ssize_t)&exn_MATCH;
       goto raise_exception;
     raise_div:
-      acc = (int)&exn_DIV;
+      acc = (ssize_t)&exn_DIV;
       goto raise_exception;
 */
     raise_overflow:
-      acc = (int)&exn_OVERFLOW;
+      acc = (ssize_t)&exn_OVERFLOW;
       goto raise_exception;
 /*
     raise_interrupt:
-      acc = (int)&exn_INTERRUPT;
+      acc = (ssize_t)&exn_INTERRUPT;
       goto raise_exception;
 */
       Instruct(PRIM_ABS_I): {
 	if ( acc < 0 ) {
-	  if ( acc == -2147483647 - 1)
+	  if ( acc == INT32_MIN)
 	    goto raise_overflow;
 	  acc = -acc;
 	}
@@ -773,7 +944,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 
       Instruct(PRIM_SUB_I1): {
-	if ( acc == Min_Int ) goto raise_overflow;
+	if ( acc == INT32_MIN ) goto raise_overflow;
 	acc = acc - 1;
 	Next;
 	/*
@@ -785,7 +956,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 
       Instruct(PRIM_SUB_I2): {
-	if ( acc == Min_Int || acc == Min_Int + 1 ) goto raise_overflow;
+	if ( acc == INT32_MIN || acc == INT32_MIN + 1 ) goto raise_overflow;
 	acc = acc - 2;
 	Next;
 	/*
@@ -797,18 +968,16 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 
       Instruct(PRIM_SUB_I): {
-	int temp1 = popValDef;
-	temp = acc;
-	acc = temp1 - temp;
+	int64_t r = (int64_t)(int32)popValDef - (int32)acc;
+	acc = ofInt32(r);
 	debug(printf("PRIM_SUB_I gives %d\n", acc));
-	if ( ( temp1 > 0 && temp < 0 && (acc < -temp || acc < temp1) ) 
-	     || ( temp1 <= 0 && temp > 0 && (acc > -temp || acc > temp1) ) )	     
+	if ( acc != r )
 	  goto raise_overflow;
 	Next;
       }
 
       Instruct(PRIM_ADD_I1): {
-	if ( acc == Max_Int ) goto raise_overflow;
+	if ( acc == INT32_MAX ) goto raise_overflow;
 	acc = acc + 1;
 	Next;
 	/*      
@@ -820,7 +989,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 
       Instruct(PRIM_ADD_I2): {
-	if ( acc == Max_Int || acc == Max_Int - 1 ) goto raise_overflow;
+	if ( acc == INT32_MAX || acc == INT32_MAX - 1 ) goto raise_overflow;
 	acc = acc + 2;
 	Next;
 	/*
@@ -832,22 +1001,19 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 
       Instruct(PRIM_ADD_I): {
-	int temp1 = popValDef;
-	temp = acc;
-	acc = temp1 + acc;
+	int64_t r = (int64_t)(int32)popValDef + (int32)acc;
+	acc = ofInt32(r);
 	debug(printf("PRIM_ADD_I gives %d\n", acc));
-	if ( ( temp1 > 0 && temp > 0 && (acc < temp || acc < temp1) ) 
-	     || ( temp1 <= 0 && temp < 0 && (acc > temp || acc > temp1) ) )	     
+	if ( acc != r )
 	  goto raise_overflow;
 	Next;
       }
 
       Instruct(PRIM_MUL_I): {
-	int temp1 = popValDef;
-	temp = acc;
-	acc = temp1 * temp;
+	int64_t r = (int64_t)(int32)popValDef * (int32)acc;
+	acc = ofInt32(r);
 	debug(printf("PRIM_MUL_I gives %d\n", acc));
-	if ( (temp1 != 0) && (acc / temp1 != temp) )
+	if ( acc != r )
 	  goto raise_overflow;
 	Next;
       }
@@ -880,11 +1046,17 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 	if (((int)acc) != 3)
 	  branch();
 	else {
-	  inc32pc;
+	  incwpc;
 	}
 	Next;
       }
 
+      ifnotintjmp(IF_NOT_EQUAL_JMP_REL,"IF_NOT_EQUAL_JMP_REL",==);
+      ifnotintjmp(IF_NOT_LESS_THAN_JMP_REL,"IF_NOT_LESS_THAN_JMP_REL",<);
+      ifnotintjmp(IF_NOT_LESS_EQUAL_JMP_REL,"IF_NOT_LESS_EQUAL_JMP_REL",<=);
+      ifnotintjmp(IF_NOT_GREATER_THAN_JMP_REL,"IF_NOT_GREATER_THAN_JMP_REL",>);
+      ifnotintjmp(IF_NOT_GREATER_EQUAL_JMP_REL,"IF_NOT_GREATER_EQUAL_JMP_REL",>=);
+
       iftestimmed(IF_NOT_EQ_JMP_REL_IMMED,"IF_NOT_EQ_JMP_REL_IMMED",!=);
       iftestimmed(IF_LESS_THAN_JMP_REL_IMMED,"IF_LESS_THAN_JMP_REL_IMMED",<);
       iftestimmed(IF_GREATER_THAN_JMP_REL_IMMED,"IF_GREATER_THAN_JMP_REL_IMMED",>);
@@ -902,72 +1074,72 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       primftest(PRIM_GREATER_EQUAL_F,"PRIM_GREATER_EQUAL_F",>=);
 
       Instruct(JMP_VECTOR): {
-	temp = s32pc + (acc-s32_1pc)*4;
-	debug(printf("s32pc = %d \n",s32pc));
-	debug(printf("s32_1pc = %d \n",s32_1pc));
+	temp = swpc + (acc-sw_1pc);
+	debug(printf("swpc = %d \n",swpc));
+	debug(printf("sw_1pc = %d \n",sw_1pc));
 	debug(printf("acc = %d \n",acc));
 	debug(printf("JMP_VECTOR(%x) with offset %d\n", cur_instr,temp));
-	debug(printf("value in slot %x \n",(*((int32 *)(pc+temp)))));
-	pc = JUMPTGT((*((int32 *)(pc+temp)))+temp);
-	debug(printf("instruct in slot pc %x\n",s32pc));
+	debug(printf("value in slot %x \n",(*((ssize_t *)(pc+temp*WORD)))));
+	pc = JUMPTGT((*((ssize_t *)(pc+temp*WORD)))+temp);
+	debug(printf("instruct in slot pc %x\n",swpc));
 	Next;
       }
       
       Instruct(JMP_REL): {
-	debug(printf("JMP_REL with offset %d\n", s32pc));
+	debug(printf("JMP_REL with offset %d\n", swpc));
 	branch();
 	Next;
       }
       Instruct(C_CALL0): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL0(%d)\n", u32pc));
-  debug_writer1("C_CALL0(0x%x)\n", u32pc);
-	acc = ((c_primitive) u32pc)();
-	inc32pc; /* index in c_prim */
+	debug(printf("C_CALL0(%d)\n", uwpc));
+  debug_writer1("C_CALL0(0x%x)\n", uwpc);
+	acc = ((c_primitive) uwpc)();
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL0 end\n"));
 	Next;
       }
       Instruct(C_CALL1): { 
 	Setup_for_c_call;
-	//debug(printf("C_CALL1(%d) with acc %d (0x%x)\n", cprim[u32pc], acc, acc));
-	debug(printf("C_CALL1(%d) with acc %d (0x%x)\n", u32pc, acc, acc));
-  debug_writer2("C_CALL1(0x%x) with acc %d\n", u32pc, acc);
-	acc = ((c_primitive) u32pc)(acc);
-	inc32pc; /* index in c_prim */
+	//debug(printf("C_CALL1(%d) with acc %d (0x%x)\n", cprim[uwpc], acc, acc));
+	debug(printf("C_CALL1(%d) with acc %d (0x%x)\n", uwpc, acc, acc));
+  debug_writer2("C_CALL1(0x%x) with acc %d\n", uwpc, acc);
+	acc = ((c_primitive) uwpc)(acc);
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL1 end\n"));
 	Next;
       }
       Instruct(C_CALL2): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL2(%d) with acc %d and arg %d\n", u32pc, acc, selectStackDef(-1)));
-	//debug(printf("C_CALL2(%d) with acc %d and arg %d\n", cprim[u32pc], acc, selectStackDef(-1)));
-  debug_writer3("C_CALL2(0x%x) with acc %d and arg %d\n", u32pc, acc, selectStackDef(-1));
-	acc = ((c_primitive) u32pc)(popValDef, acc);
-	inc32pc; /* index in c_prim */
+	debug(printf("C_CALL2(%d) with acc %d and arg %d\n", uwpc, acc, selectStackDef(-1)));
+	//debug(printf("C_CALL2(%d) with acc %d and arg %d\n", cprim[uwpc], acc, selectStackDef(-1)));
+  debug_writer3("C_CALL2(0x%x) with acc %d and arg %d\n", uwpc, acc, selectStackDef(-1));
+	acc = ((c_primitive) uwpc)(popValDef, acc);
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL2 end\n"));
 	Next;
       }
       Instruct(C_CALL3): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL3(%d) with acc %d and arg %d\n", u32pc, acc, selectStackDef(-1)));
-  debug_writer4("C_CALL3(0x%x) with acc %d and args (%d,%d)\n", u32pc, acc, selectStackDef(-2), selectStackDef(-1));
+	debug(printf("C_CALL3(%d) with acc %d and arg %d\n", uwpc, acc, selectStackDef(-1)));
+  debug_writer4("C_CALL3(0x%x) with acc %d and args (%d,%d)\n", uwpc, acc, selectStackDef(-2), selectStackDef(-1));
 	temp = popValDef;
-	acc = ((c_primitive) u32pc)(popValDef, temp, acc);
-	inc32pc; /* index in c_prim */
+	acc = ((c_primitive) uwpc)(popValDef, temp, acc);
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL3 end\n"));
 	Next;
       }
       Instruct(C_CALL4): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL4 - %d - (%d,%d,%d,%d)\n", u32pc, selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc));
-  debug_writer5("C_CALL4(0x%x) with acc %d and args (%d,%d,%d)\n", u32pc, acc, selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
-	acc = ((c_primitive) u32pc)(selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc);
+	debug(printf("C_CALL4 - %d - (%d,%d,%d,%d)\n", uwpc, selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc));
+  debug_writer5("C_CALL4(0x%x) with acc %d and args (%d,%d,%d)\n", uwpc, acc, selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
+	acc = ((c_primitive) uwpc)(selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc);
 	popNDef(3);
-	inc32pc; /* index in c_prim */
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL4 end\n"));
 	Next;
@@ -975,12 +1147,12 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 
       Instruct(C_CALL5): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL5 - %d - (%d,%d,%d,%d,%d)\n", u32pc, selectStackDef(-4), 
+	debug(printf("C_CALL5 - %d - (%d,%d,%d,%d,%d)\n", uwpc, selectStackDef(-4), 
 		     selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc));
-  debug_writer6("C_CALL5(0x%x) with acc %d and args (%d,%d,%d,%d)\n", u32pc, acc, selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
-	acc = ((c_primitive) u32pc)(selectStackDef(-4), selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc);
+  debug_writer6("C_CALL5(0x%x) with acc %d and args (%d,%d,%d,%d)\n", uwpc, acc, selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
+	acc = ((c_primitive) uwpc)(selectStackDef(-4), selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc);
 	popNDef(4);
-	inc32pc; /* index in c_prim */
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL5 end\n"));
 	Next;
@@ -988,13 +1160,13 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 
       Instruct(C_CALL6): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL6 - %d - (%d,%d,%d,%d,%d,%d)\n", u32pc, selectStackDef(-5), 
+	debug(printf("C_CALL6 - %d - (%d,%d,%d,%d,%d,%d)\n", uwpc, selectStackDef(-5), 
 		     selectStackDef(-4), selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc));
-  debug_writer7("C_CALL6(0x%x) with acc %d and args (%d,%d,%d,%d,%d)\n", u32pc, acc, selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
-	acc = ((c_primitive) u32pc)(selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),
+  debug_writer7("C_CALL6(0x%x) with acc %d and args (%d,%d,%d,%d,%d)\n", uwpc, acc, selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
+	acc = ((c_primitive) uwpc)(selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),
                        selectStackDef(-1), acc);
 	popNDef(5);
-	inc32pc; /* index in c_prim */
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL6 end\n"));
 	Next;
@@ -1002,14 +1174,14 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 
       Instruct(C_CALL7): { 
 	Setup_for_c_call;
-	debug(printf("C_CALL7 - %d - (%d,%d,%d,%d,%d,%d,%d)\n", u32pc, selectStackDef(-6), 
+	debug(printf("C_CALL7 - %d - (%d,%d,%d,%d,%d,%d,%d)\n", uwpc, selectStackDef(-6), 
 		     selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),
          selectStackDef(-1), acc));
-  debug_writer8("C_CALL7(0x%x) with acc %d and args (%d,%d,%d,%d,%d,%d)\n", u32pc, acc, selectStackDef(-6), selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
-	acc = ((c_primitive) u32pc)(selectStackDef(-6), selectStackDef(-5), selectStackDef(-4),
+  debug_writer8("C_CALL7(0x%x) with acc %d and args (%d,%d,%d,%d,%d,%d)\n", uwpc, acc, selectStackDef(-6), selectStackDef(-5), selectStackDef(-4), selectStackDef(-3), selectStackDef(-2),selectStackDef(-1));
+	acc = ((c_primitive) uwpc)(selectStackDef(-6), selectStackDef(-5), selectStackDef(-4),
                               selectStackDef(-3), selectStackDef(-2), selectStackDef(-1), acc);
 	popNDef(6);
-	inc32pc; /* index in c_prim */
+	incwpc; /* index in c_prim */
 	Restore_after_c_call;
 	debug(printf("C_CALL7 end\n"));
 	Next;
@@ -1026,109 +1198,127 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 	Next;
       }
 
-      Instruct(SELECT_STACK_M1): { acc = selectStackDef(-1); Next; }
+      Instruct(SELECT_STACK_M1): { acc = selectStackTop; Next; }
       Instruct(SELECT_STACK_M2): { acc = selectStackDef(-2); Next; }
       Instruct(SELECT_STACK_M3): { acc = selectStackDef(-3); Next; }
       Instruct(SELECT_STACK_M4): { acc = selectStackDef(-4); Next; }
       Instruct(SELECT_STACK_N): {
-	debug(printf("SELECT_STACK_N %d\n", s32pc));
-	acc = selectStackDef(s32pc);
-	inc32pc;
+	debug(printf("SELECT_STACK_N %d\n", swpc));
+	acc = selectStackDef(swpc);
+	incwpc;
 	Next;
       }
 
-      Instruct(SELECT_0): { acc = *(int *)acc; Next; }
-      Instruct(SELECT_1): { acc = *((int *)acc + 1); Next; }
-      Instruct(SELECT_2): { acc = *((int *)acc + 2); Next; }
-      Instruct(SELECT_3): { acc = *((int *)acc + 3); Next; }
+      Instruct(SELECT_0): { acc = *(uintptr_t *)acc; Next; }
+      Instruct(SELECT_1): { acc = *((uintptr_t *)acc + 1); Next; }
+      Instruct(SELECT_2): { acc = *((uintptr_t *)acc + 2); Next; }
+      Instruct(SELECT_3): { acc = *((uintptr_t *)acc + 3); Next; }
       Instruct(SELECT_N): {
-	debug(printf("SELECT_N %d\n", s32pc));	
-	acc = *(((int *)acc) + s32pc);
-	inc32pc;
+	debug(printf("SELECT_N %d\n", swpc));	
+	acc = *(((uintptr_t *)acc) + swpc);
+	incwpc;
 	Next;
       }
 
       Instruct(SELECT_ENV_N): {
-	debug(printf("SELECT_ENV_N %d - env = 0x%x\n", s32pc, env));
-  debug_writer2("SELECT_ENV_N %d - env = 0x%x\n", (int) s32pc, (int) env);
-	acc = *(env + s32pc);
-	inc32pc;
+	debug(printf("SELECT_ENV_N %d - env = 0x%x\n", swpc, env));
+  debug_writer2("SELECT_ENV_N %d - env = 0x%x\n", (ssize_t) swpc, (ssize_t) env);
+	acc = *(env + swpc);
+	incwpc;
+	Next;
+      }
+      // Superinstructions; see the peephole functions in CodeGenKAM.sml
+
+      Instruct(SELECT_STACK_SELECT): {
+	debug(printf("SELECT_STACK_SELECT %d %d\n", swpc, sw_1pc));
+	acc = selectStackDef(swpc);
+	acc = *(((uintptr_t *)acc) + sw_1pc);
+	inc2_wpc;
+	Next;
+      }
+
+      Instruct(SELECT_ENV_SELECT): {
+	debug(printf("SELECT_ENV_SELECT %d %d\n", swpc, sw_1pc));
+	acc = *(env + swpc);
+	acc = *(((uintptr_t *)acc) + sw_1pc);
+	inc2_wpc;
 	Next;
       }
+
       Instruct(ENV_TO_ACC): {
 	debug(printf("ENV_TO_ACC\n"));
-	acc = (int) env;
+	acc = (ssize_t) env;
 	Next;
       }
 
-      Instruct(STORE_0): { *(int *)popValDef = acc; acc = mlUNIT; Next; }
-      Instruct(STORE_1): { *((int *)popValDef + 1) = acc; acc = mlUNIT; Next; }
-      Instruct(STORE_2): { *((int *)popValDef + 2) = acc; acc = mlUNIT; Next; }
-      Instruct(STORE_3): { *((int *)popValDef + 3) = acc; acc = mlUNIT; Next; }
+      Instruct(STORE_0): { *(uintptr_t *)popValDef = acc; acc = mlUNIT; Next; }
+      Instruct(STORE_1): { *((uintptr_t *)popValDef + 1) = acc; acc = mlUNIT; Next; }
+      Instruct(STORE_2): { *((uintptr_t *)popValDef + 2) = acc; acc = mlUNIT; Next; }
+      Instruct(STORE_3): { *((uintptr_t *)popValDef + 3) = acc; acc = mlUNIT; Next; }
       Instruct(STORE_N): {
 	debug(printf("STORE_N %d \n", acc));
-	temp = (int)(((int *)popValDef) + s32pc); 
-	*((int *)temp) = acc;
+	temp = (ssize_t)(((uintptr_t *)popValDef) + swpc); 
+	*((uintptr_t *)temp) = acc;
 	debug(printf("Writing to sp = 0x%x\n", temp));
 	acc = mlUNIT;
-	inc32pc;
+	incwpc;
 	Next;
       }
 
       Instruct(STACK_ADDR_INF_BIT) : {
-	acc = (int) (sp + s32pc);
+	acc = (ssize_t) (sp + swpc);
 	acc = setInfiniteBit(acc);              /* bug fix - inserted acc = ... */
-	debug(printf("STACK_ADDR_INF_BIT %d at %d (0x%x)\n", s32pc, acc, acc));
-	inc32pc;
+	debug(printf("STACK_ADDR_INF_BIT %d at %d (0x%x)\n", swpc, acc, acc));
+	incwpc;
 	Next;
       }
       Instruct(STACK_ADDR): {
-	acc = (int) (sp + s32pc);
-	debug(printf("STACK_ADDR %d at %x\n", s32pc, acc));
-	inc32pc;
+	acc = (ssize_t) (sp + swpc);
+	debug(printf("STACK_ADDR %d at %x\n", swpc, acc));
+	incwpc;
 	Next;
       }
 
       Instruct(RETURN_1_1): {
 	pc_temp = (bytecode_t) selectStackDef(-3);
-	env = (int *) selectStackDef(-2);
+	env = (uintptr_t *) selectStackDef(-2);
 	popNDef(3);
 	pc = pc_temp;
 	Next;
       }
       Instruct(RETURN_N_1): {
-	pc_temp = (bytecode_t) selectStackDef(-s32pc-2);
-	env = (int *) selectStackDef(-s32pc-1);
-	popNDef(s32pc+2);
+	pc_temp = (bytecode_t) selectStackDef(-swpc-2);
+	env = (uintptr_t *) selectStackDef(-swpc-1);
+	popNDef(swpc+2);
 	pc = pc_temp;
 	Next;
       }
       Instruct(RETURN): {
-	debug(printf("RETURN(old_args %d,res %d)\n",s32pc,s32_1pc));
-	pc_temp = (bytecode_t) selectStackDef(-s32_1pc-s32pc-1);
-	debug(printf("Return-pointer stack-slot = 0x%x\n", sp -s32_1pc-s32pc-1));
-	env = (int *) selectStackDef(-s32pc-s32_1pc);
-	for (temp=0;temp<s32_1pc-1;temp++) {
-	  selectStackDef(-s32_1pc-s32pc-1+temp) = selectStackDef(-s32_1pc+1+temp);
-	  debug(printf("Writing to sp = 0x%x\n", sp -s32_1pc-s32pc-1+temp));
+	debug(printf("RETURN(old_args %d,res %d)\n",swpc,sw_1pc));
+	pc_temp = (bytecode_t) selectStackDef(-sw_1pc-swpc-1);
+	debug(printf("Return-pointer stack-slot = 0x%x\n", sp -sw_1pc-swpc-1));
+	env = (uintptr_t *) selectStackDef(-swpc-sw_1pc);
+	for (temp=0;temp<sw_1pc-1;temp++) {
+	  selectStackDef(-sw_1pc-swpc-1+temp) = selectStackDef(-sw_1pc+1+temp);
+	  debug(printf("Writing to sp = 0x%x\n", sp -sw_1pc-swpc-1+temp));
 	}
-	popNDef(s32pc+2);
+	popNDef(swpc+2);
 	pc = pc_temp;
 	Next;
       }
 
       Instruct(STORE_DATA): { 
-	debug(printf("STORE_DATA(%x) (acc = %d; 0x%x) - slot = 0x%x - ds = 0x%x\n", s32pc, acc, acc, ds + s32pc, ds));
-  debug_writer4("STORE_DATA acc = 0x%x - ds = 0x%x - *pc = 0x%x - ds + s32pc = 0x%x\n", acc, (int) ds, s32pc, (int) (ds+s32pc));
-	*(ds + s32pc) = acc;
-	inc32pc;
+	debug(printf("STORE_DATA(%x) (acc = %d; 0x%x) - slot = 0x%x - ds = 0x%x\n", swpc, acc, acc, ds + swpc, ds));
+  debug_writer4("STORE_DATA acc = 0x%x - ds = 0x%x - *pc = 0x%x - ds + swpc = 0x%x\n", acc, (ssize_t) ds, swpc, (ssize_t) (ds+swpc));
+	*(ds + swpc) = acc;
+	incwpc;
 	Next;
       }
       Instruct(FETCH_DATA): { 
-	debug(printf("FETCH_DATA(%x)\n", s32pc));
-  debug_writer3("FETCH_DATA *pc = 0x%x - ds = 0x%x - *(ds + *pc) = 0x%x\n", s32pc, (int) ds, *(ds + s32pc));
-	acc = *(ds + s32pc);
-	inc32pc;
+	debug(printf("FETCH_DATA(%x)\n", swpc));
+  debug_writer3("FETCH_DATA *pc = 0x%x - ds = 0x%x - *(ds + *pc) = 0x%x\n", swpc, (ssize_t) ds, *(ds + swpc));
+	acc = *(ds + swpc);
+	incwpc;
 	Next;
       }
       Instruct(HALT): { 
@@ -1196,17 +1386,17 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       }
 
       Instruct(STACK_OFFSET): {   /*mael*/
-	debug(printf("STACK_OFFSET %d at %x\n", u32pc, (int)sp));
-	offsetSP(u32pc);
-	inc32pc;
+	debug(printf("STACK_OFFSET %d at %x\n", uwpc, (ssize_t)sp));
+	offsetSP(uwpc);
+	incwpc;
 	Next;
       }
 	
       Instruct(POP_PUSH): {   /*mael*/
-	popNDef(s32pc);
+	popNDef(swpc);
 	pushDef(acc);
-	debug(printf("POP_PUSH(%d) - sp = 0x%x\n",s32pc, sp));
-	inc32pc;
+	debug(printf("POP_PUSH(%d) - sp = 0x%x\n",swpc, sp));
+	incwpc;
 	Next;
       }
 
@@ -1215,8 +1405,8 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(IMMED_INT_PUSH2): { pushDef(2); Next; }  /*mael*/
       Instruct(IMMED_INT_PUSH3): { pushDef(3); Next; }  /*mael*/
       Instruct(IMMED_INT_PUSH): {                       /*mael*/
-	pushDef(s32pc);
-	inc32pc;
+	pushDef(swpc);
+	incwpc;
 	debug(printf("IMMED_INT_PUSH\n"));
 	Next;
       }
@@ -1226,45 +1416,45 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(SELECT_PUSH2): {	pushDef(*((ssize_t *)acc + 2)); Next; }    /*mael*/
       Instruct(SELECT_PUSH3): {	pushDef(*((ssize_t *)acc + 3)); Next; }    /*mael*/
       Instruct(SELECT_PUSH): {                                         /*mael*/
-	debug(printf("SELECT_PUSH(%d)\n", s32pc));	
-	pushDef(*(((ssize_t *)acc) + s32pc));
-	inc32pc;
+	debug(printf("SELECT_PUSH(%d)\n", swpc));	
+	pushDef(*(((ssize_t *)acc) + swpc));
+	incwpc;
 	Next;
       }
 
       Instruct(SELECT_ENV_PUSH): {   /*mael*/
-	debug(printf("SELECT_ENV_PUSH %d - env = 0x%x\n", s32pc, env));
-  debug_writer3("SELECT_ENV_PUSH %d - env = 0x%x - newtop = 0x%x\n", s32pc, (int) env, *(env + s32pc));
-	pushDef(*(env + s32pc));
-	inc32pc;
+	debug(printf("SELECT_ENV_PUSH %d - env = 0x%x\n", swpc, env));
+  debug_writer3("SELECT_ENV_PUSH %d - env = 0x%x - newtop = 0x%x\n", swpc, (ssize_t) env, *(env + swpc));
+	pushDef(*(env + swpc));
+	incwpc;
 	Next;
       }
 
       Instruct(SELECT_ENV_CLEAR_ATBOT_BIT_PUSH): {   /*mael*/
-	debug(printf("SELECT_ENV_CLEAR_ATBOT_BIT_PUSH %d - env = 0x%x\n", s32pc, env));
-	pushDef(clearAtbotBit(*(env + s32pc)));
-	inc32pc;
+	debug(printf("SELECT_ENV_CLEAR_ATBOT_BIT_PUSH %d - env = 0x%x\n", swpc, env));
+	pushDef(clearAtbotBit(*(env + swpc)));
+	incwpc;
 	Next;
       }
 
       Instruct(STACK_ADDR_PUSH): {   /*mael*/
-	pushDef((ssize_t)(sp + s32pc));
-	debug(printf("STACK_ADDR_PUSH %d\n", s32pc));
-	inc32pc;
+	pushDef((ssize_t)(sp + swpc));
+	debug(printf("STACK_ADDR_PUSH %d\n", swpc));
+	incwpc;
 	Next;
       }
 
       Instruct(STACK_ADDR_INF_BIT_ATBOT_BIT_PUSH): {   /*mael*/
-	pushDef(setStatusBits((ssize_t)(sp + s32pc)));
-	debug(printf("STACK_ADDR_INF_BIT_ATBOT_BIT_PUSH(%d)\n", s32pc));
-	inc32pc;
+	pushDef(setStatusBits((ssize_t)(sp + swpc)));
+	debug(printf("STACK_ADDR_INF_BIT_ATBOT_BIT_PUSH(%d)\n", swpc));
+	incwpc;
 	Next;
       }
 
       Instruct(SELECT_STACK_PUSH): {   /*mael*/
-	debug(printf("SELECT_STACK_PUSH(%d)\n", s32pc));
-	pushDef(selectStackDef(s32pc));
-	inc32pc;
+	debug(printf("SELECT_STACK_PUSH(%d)\n", swpc));
+	pushDef(selectStackDef(swpc));
+	incwpc;
 	Next;
       }
 
@@ -1277,7 +1467,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(PRIM_SUB_I31): {
 	debug(printf("PRIM_SUB_I31\n"));
 	temp = i31_to_i32ub((ssize_t)(popValDef)) - i31_to_i32ub(acc);
-	acc = i32ub_to_i31(temp);
+	acc = ofInt32(i32ub_to_i31(temp));
 	if ( i31_to_i32ub(acc) != temp )
 	  goto raise_overflow;
 	Next;
@@ -1286,7 +1476,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(PRIM_ADD_I31): {
 	debug(printf("PRIM_ADD_I31\n"));
 	temp = i31_to_i32ub((int)(popValDef)) + i31_to_i32ub(acc);
-	acc = i32ub_to_i31(temp);
+	acc = ofInt32(i32ub_to_i31(temp));
 	if ( i31_to_i32ub(acc) != temp )
 	  goto raise_overflow;
 	Next;
@@ -1307,14 +1497,14 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
         if( y > MaxChunk ) 
 	  goto raise_overflow;
         if( x <= MaxChunk ) { 
-	  acc = i32ub_to_i31(isNegative?(-(x * y)):(x * y)); 
+	  acc = ofInt32(i32ub_to_i31(isNegative?(-(x * y)):(x * y))); 
 	} else { /* x > MaxChunk */
 	  temp = (x >> ChunkLen) * y;
 	  if( temp > MaxChunk + 1) 
 	    goto raise_overflow;
 	  temp = (temp << ChunkLen) + (x & MaxChunk) * y;
 	  if( isNegative ) temp = - temp;
-	  acc = i32ub_to_i31(temp);
+	  acc = ofInt32(i32ub_to_i31(temp));
 	  if( i31_to_i32ub(acc) != temp ) 
 	    goto raise_overflow;
 	}
@@ -1324,7 +1514,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(PRIM_NEG_I31): {
 	debug(printf("PRIM_NEG_I31\n"));
 	temp = - i31_to_i32ub(acc);
-	acc = i32ub_to_i31(temp);
+	acc = ofInt32(i32ub_to_i31(temp));
 	if( i31_to_i32ub(acc) != temp ) 
 	  goto raise_overflow;
 	Next;
@@ -1334,7 +1524,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 	debug(printf("PRIM_ABS_I31\n"));
 	if ( acc < 0 ) {
 	  temp = - i31_to_i32ub(acc);
-	  acc = i32ub_to_i31(temp);
+	  acc = ofInt32(i32ub_to_i31(temp));
 	  if( i31_to_i32ub(acc) != temp ) 
 	    goto raise_overflow;
 	}
@@ -1361,7 +1551,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 
       Instruct(PRIM_SHIFT_RIGHT_UNSIGNED_W31): {   /* shift amount is untagged */
 	debug(printf("PRIM_SHIFT_RIGHT_UNSIGNED_W31\n"));
-	acc = 1 | ( ((unsigned int)(popValDef) - 1) >> acc );
+	acc = ofInt32(1 | ( ((unsigned int)(popValDef) - 1) >> acc ));
 	Next;
       }
 
@@ -1394,7 +1584,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
       Instruct(PRIM_I_TO_I31): {
 	debug(printf("PRIM_I_TO_I31\n"));
 	temp = acc;
-	acc = i32ub_to_i31(acc);
+	acc = ofInt32(i32ub_to_i31(acc));
 	if ( i31_to_i32ub(acc) != temp )
 	  goto raise_overflow;
 	Next;
@@ -1408,7 +1598,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 
       Instruct(PRIM_W_TO_W31): {
 	debug(printf("PRIM_W_TO_W31\n"));
-	acc = i32ub_to_i31(acc);
+	acc = ofInt32(i32ub_to_i31(acc));
 	Next;
       }
 
@@ -1425,6 +1615,20 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 	Next;
       }
 
+      /* The result of a C function declared to return int; only the
+       * low 32 bits of the result register are defined. */
+      Instruct(PRIM_CINT_TO_I): {
+	debug(printf("PRIM_CINT_TO_I\n"));
+	acc = ofInt32(acc);
+	Next;
+      }
+
+      Instruct(PRIM_STRING_TO_CSTRING): {
+	debug(printf("PRIM_STRING_TO_CSTRING\n"));
+	acc = (ssize_t)&(((String)acc)->data);
+	Next;
+      }
+
       Instruct(PRIM_BYTETABLE_SUB): {
 	debug(printf("PRIM_BYTETABLE_SUB(%d,%d)\n", selectStackDef(-1), acc));
 	acc = (int)(*((unsigned char *)(&(((String)(popValDef))->data) + acc)));
@@ -1467,35 +1671,35 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 	  // Passing state around; used in apache to pass request_rec with the connection
       Instruct(GET_CONTEXT): {
 	 debug(printf("GET_CONTEXT\n"));
-	 acc = (int) serverCtx->aux;
+	 acc = (ssize_t) serverCtx->aux;
 	 Next;
 	  }
       
       Instruct(CHECK_LINKAGE): {
-		if (u32pc == 0)
+		if (uwpc == 0)
 		{
 			acc = popValDef;
-			inc32pc;  /* Index in dynamic_funcs */
+			incwpc;  /* Index in dynamic_funcs */
 			Next;
 		}
 		else 
 		{
 			Setup_for_c_call;
-			if (u32pc == 1) 
+			if (uwpc == 1) 
 			{
 				localResolveLibFnAuto(((const void **) pc)+2, (const char *) (&(((String) acc)->data)));
 			}
-			else if (u32pc == 2)
+			else if (uwpc == 2)
 			{
 				localResolveLibFnAuto(((const void **) pc)+2, (const char *) acc);
 			}
-      if (u32_2pc == 0) 
+      if (uw_2pc == 0) 
       {
-        raise_exn((int) &exn_MATCH);
+        raise_exn((uintptr_t) &exn_MATCH);
       }
-			u32pc = 0;
+			uwpc = 0;
 			acc = popValDef;
-			inc32pc;  /* Index in dynamic_funcs */
+			incwpc;  /* Index in dynamic_funcs */
 			Restore_after_c_call;
 			Next;
 		}
@@ -1508,7 +1712,7 @@ interp(Interp* interpreter,    // Interp; NULL if mode=RESOLVEINSTS
 #else
     default: {
 #endif /*LAB_THREADED*/ 
-	printf("Default: Instruction %d(hex %x) not recognized\n", cur_instr, cur_instr);
+	printf("Default: Instruction %lu(hex %lx) not recognized\n", (unsigned long)cur_instr, (unsigned long)cur_instr);
 	printf("Stack pointer sp = %p\n", sp);
 	printf("Code pointer pc = %p\n", pc);
 	die("Instruction not recognized");
@@ -1535,7 +1739,7 @@ interpCode(Interp* interpreter,         // The interpreter
 	   void *serverCtx)             // Apache request_rec pointer
 {
   debug_writer1("interpCode %d interp\n",0);
-  int res = interp(interpreter, sp, ds, exnPtr, topRegionCell, errorStr,
+  ssize_t res = interp(interpreter, sp, ds, exnPtr, topRegionCell, errorStr,
                    exnCnt, b_prog, 0, INTERPRET, serverCtx);    
   debug_writer1("interpCode %d interp DONE\n",0);
                                             // sizeW not used when mode is INTERPRET
@@ -1554,12 +1758,13 @@ resolveCode(bytecode_t b_prog,              // Code to resolve
 void print_code(bytecode_t b_prog, int code_size) {
   int j;
   for (j=0;j<code_size/4;j++)
-    printf("start_code[%d]=%x\n",j,*(((int *)b_prog) + j));
+    printf("start_code[%d]=%lx\n",j,(unsigned long)*(((uintptr_t *)b_prog) + j));
   return;
 }
 
 extern int  commandline_argc;
 extern char **commandline_argv;
+extern int  app_arg_index;
 
 #ifndef APACHE
 void report(enum reportLevel level, const char *data, void *notused)
@@ -1601,15 +1806,16 @@ main_interp(int argc, char * argv[]) {
   
   debug(printf("[Number of command-line arguments (including name of executable): %d]\n", argc));
 
-  // the arguments after ``--args'' are the command-line arguments 
-  // passed by the user to the executable ./run
+  // the switches recognised by parseCmdLineArgs come first and are
+  // skipped; the arguments after ``--args'' are the command-line
+  // arguments passed by the user to the executable ./run
 
-  for (c = 1; c < argc && strcmp(argv[c], "--args") != 0; c ++) {
+  for (c = app_arg_index; c < argc && strcmp(argv[c], "--args") != 0; c ++) {
     debug(printf("[Loading bytecode file %s]\n", argv[c]));
     interpLoadExtend(interp, argv[c], &ss);
   }
 
-  if ( strcmp(argv[c], "--args") != 0 ) {
+  if ( c >= argc || strcmp(argv[c], "--args") != 0 ) {
     (*(ss.report)) (CONTINUE, "expecting ``--args'' option to command", ss.aux);
     return -1;
   }
@@ -1622,6 +1828,7 @@ main_interp(int argc, char * argv[]) {
 
   commandline_argc = c;
   commandline_argv = argv;
+  app_arg_index = 1;
 
   debug(printf("[Running interpreter]\n"));
   res = interpRun(interp, NULL, &errorStr, &ss);
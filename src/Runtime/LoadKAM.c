@@ -3,7 +3,9 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -21,6 +23,7 @@
 #include <string.h>
 #include "Locks.h"
 #include "LogLevel.h"
+#include "SharedCode.h"
 #endif
 
 #ifdef DEBUG
@@ -76,7 +79,8 @@ void
 strToCodeMapClear_fn(const char* k,bytecode_t code)
 {
   free((void *) k);
-  free(code);
+  if ( ! sharedCodeOwns(code) )
+    free(code);
 }
 
 strToCodeMap
@@ -191,6 +195,7 @@ interpNew(void)
   interp->data_size = INTERP_INITIAL_DATASIZE;
 #if ( THREADS && CODE_CACHE )
   interp->codeCache = strToCodeMap_new();
+  interp->libraryKey = (uintptr_t)interpCode;
 #endif
   /*  debug(printf("interpNew4\n")); */
   return interp;
@@ -234,91 +239,167 @@ longListFree(LongList* longList)
     }
 }
 
-// read_long: read a long from a buffer
+/* -----------------------------------------------------
+ * Reading bytecode files
+ *
+ * A bytecode file is mapped into memory with mmap (or, if the file
+ * cannot be mapped, read into a malloc'ed buffer) and the header, the
+ * code block, and the import and export tables are then read from
+ * the image. Labels that are only looked up (those of the import
+ * tables) are read into a scratch label owned by the KamFile; only
+ * labels that are inserted in a label map are malloc'ed.
+ * ----------------------------------------------------- */
+
+typedef struct {
+  const unsigned char *image;  // the content of the file
+  size_t size;                 // size of the file in bytes
+  size_t pos;                  // offset in image of the next item to read
+  int mapped;                  // 1 if image is mapped, 0 if malloc'ed
+  label scratch;               // see read_label_tmp
+  size_t scratch_size;         // bytes allocated for scratch
+} KamFile;
+
 #define READ_ERROR -1
 #define READ_OK 0
 
 static int
-read_unsigned_long(FILE* fd, unsigned long* v_ptr) 
+kam_file_open(const char* name, KamFile* kf)
 {
-  unsigned char buffer[sizeof(unsigned long)];
-  int i,c;
+  struct stat st;
+  ssize_t n;
+  size_t got;
+  void *p;
+  int fd;
+
+  kf->image = NULL;
+  kf->size = 0;
+  kf->pos = 0;
+  kf->mapped = 0;
+  kf->scratch = NULL;
+  kf->scratch_size = 0;
+
+  if ( (fd = open(name, O_RDONLY)) < 0 )
+    return FILE_NOT_FOUND;
+  if ( fstat(fd, &st) < 0 || st.st_size == 0 )
+    {
+      close(fd);
+      return TRUNCATED_FILE;
+    }
+  kf->size = (size_t)st.st_size;
 
-  for ( i = 0 ; i < sizeof(unsigned long) ; i++ ) 
+  p = mmap(NULL, kf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if ( p != MAP_FAILED )
     {
-      if ( (c = fgetc(fd)) == EOF )
-	return READ_ERROR;
-      buffer[i] = (unsigned char)c;
-  }
-  *v_ptr = *(unsigned long*)buffer;
-  return READ_OK;
+      kf->image = (const unsigned char *)p;
+      kf->mapped = 1;
+      close(fd);
+      return 0;
+    }
+
+  if ( (p = malloc(kf->size)) == NULL )
+    die2("kam_file_open: cannot allocate memory for ", name);
+  for ( got = 0 ; got < kf->size ; got += n )
+    if ( (n = read(fd, (char *)p + got, kf->size - got)) <= 0 )
+      {
+	free(p);
+	close(fd);
+	return TRUNCATED_FILE;
+      }
+  close(fd);
+  kf->image = (const unsigned char *)p;
+  return 0;
 }
 
+static void
+kam_file_close(KamFile* kf)
+{
+  if ( kf->mapped )
+    munmap((void *)kf->image, kf->size);
+  else
+    free((void *)kf->image);
+  free(kf->scratch);
+  kf->image = NULL;
+  kf->scratch = NULL;
+}
+
+// read_unsigned_long: read an unsigned long from the file; the
+// numbers of the file are 32 bits (see BuffCode.sml)
 static int
-read_string_buf(FILE* fd,unsigned long n,char* buf)
+read_unsigned_long(KamFile* kf, unsigned long* v_ptr) 
 {
-  unsigned long i;
-  int c;
-  for ( i = 0 ; i < n ; i++ ) 
-    {
-      if ( (c = fgetc(fd)) == EOF)
-	return READ_ERROR;
-      buf[i] = (char)c;
-    }
-  buf[i] = 0;
+  uint32_t v;
+  if ( kf->size - kf->pos < sizeof(uint32_t) )
+    return READ_ERROR;
+  memcpy(&v, kf->image + kf->pos, sizeof(uint32_t));
+  kf->pos += sizeof(uint32_t);
+  *v_ptr = v;
   return READ_OK;
 }
 
+// A label is layed out in the file as  |id;sz_str;chars| - no trailing zero
 static int
-skip_string_buf(FILE* fd,unsigned long n)
+read_label_size(KamFile* kf, unsigned long* id, unsigned long* str_sz)
 {
-  unsigned long i;
-  int c;
-  for ( i = 0 ; i < n ; i++ ) 
-  {
-    if ( (c = fgetc(fd)) == EOF)
-      return READ_ERROR;
-  }
+  if ( read_unsigned_long(kf, id) == READ_ERROR
+       || read_unsigned_long(kf, str_sz) == READ_ERROR
+       || kf->size - kf->pos < *str_sz )
+    return READ_ERROR;
   return READ_OK;
 }
 
-// A label is layed out in the file as  |id;sz_str;chars| - no trailing zero
+static void
+copy_label(KamFile* kf, label lab, unsigned long id, unsigned long str_sz)
+{
+  lab->id = id;
+  memcpy(&(lab->base), kf->image + kf->pos, str_sz);
+  (&(lab->base))[str_sz] = 0;
+  kf->pos += str_sz;
+}
+
+// read_label: read a label into malloc'ed memory owned by the caller
 static int
-read_label(FILE* fd, label* lab_ptr) 
+read_label(KamFile* kf, label* lab_ptr) 
 {
   label lab;
   unsigned long id, str_sz;
-  if ( read_unsigned_long(fd, &id) == READ_ERROR )
-    return READ_ERROR;
-  if ( read_unsigned_long(fd, &str_sz) == READ_ERROR )
+  if ( read_label_size(kf, &id, &str_sz) == READ_ERROR )
     return READ_ERROR;
   lab = (label)malloc(str_sz + 1 + sizeof(long));
   if ( lab == 0 )
     die ("read_label: failed to allocate memory for label");
-  lab->id = id;
-  if ( read_string_buf(fd,str_sz,&(lab->base)) == READ_ERROR )
-    {
-      free(lab);
-      return READ_ERROR;
-    }
+  copy_label(kf, lab, id, str_sz);
   debug(printf("read_label: id = %d; str_sz = %d; base = %s\n", id, str_sz, &(lab->base)));
   *lab_ptr = lab;
   return READ_OK;
 }
 
-// A label is layed out in the file as  |id;sz_str;chars| - no trailing zero
+// read_label_tmp: read a label into the scratch label of the file;
+// the label is valid until the next call
 static int
-skip_label(FILE* fd) 
+read_label_tmp(KamFile* kf, label* lab_ptr) 
 {
-  unsigned long str_sz;
-  if ( read_unsigned_long(fd, &str_sz) == READ_ERROR )
-    return READ_ERROR;
-  if ( read_unsigned_long(fd, &str_sz) == READ_ERROR )
+  unsigned long id, str_sz;
+  if ( read_label_size(kf, &id, &str_sz) == READ_ERROR )
     return READ_ERROR;
-  if ( skip_string_buf(fd,str_sz) == READ_ERROR )
+  if ( str_sz + 1 + sizeof(long) > kf->scratch_size )
     {
-      return READ_ERROR;
+      kf->scratch_size = 2 * (str_sz + 1 + sizeof(long));
+      kf->scratch = (label)realloc(kf->scratch, kf->scratch_size);
+      if ( kf->scratch == 0 )
+	die ("read_label_tmp: failed to allocate memory for label");
     }
+  copy_label(kf, kf->scratch, id, str_sz);
+  *lab_ptr = kf->scratch;
+  return READ_OK;
+}
+
+static int
+skip_label(KamFile* kf) 
+{
+  unsigned long id, str_sz;
+  if ( read_label_size(kf, &id, &str_sz) == READ_ERROR )
+    return READ_ERROR;
+  kf->pos += str_sz;
   debug(printf("skip_label: str_sz = %d\n", str_sz));
   return READ_OK;
 }
@@ -345,18 +426,19 @@ print_exec_header(struct exec_header* exec_header)
 	 exec_header->magic);
 }
 */
-// read_exec_header: Leaves fd at the beginning of the code 
-// segment on success
+// read_exec_header: Leaves kf at the beginning of the code 
+// segment on success; the main label is malloc'ed
 static int 
-read_exec_header(FILE* fd, struct exec_header * exec_header) 
-{
-  if ( read_unsigned_long(fd, &(exec_header->code_size)) == READ_ERROR
-       || read_label(fd, &(exec_header->main_lab_opt)) == READ_ERROR
-       || read_unsigned_long(fd, &(exec_header->import_size_code)) == READ_ERROR
-       || read_unsigned_long(fd, &(exec_header->import_size_data)) == READ_ERROR
-       || read_unsigned_long(fd, &(exec_header->export_size_code)) == READ_ERROR
-       || read_unsigned_long(fd, &(exec_header->export_size_data)) == READ_ERROR
-       || read_unsigned_long(fd, &(exec_header->magic)) == READ_ERROR )
+read_exec_header(KamFile* kf, struct exec_header * exec_header) 
+{
+  exec_header->main_lab_opt = NULL;
+  if ( read_unsigned_long(kf, &(exec_header->code_size)) == READ_ERROR
+       || read_label(kf, &(exec_header->main_lab_opt)) == READ_ERROR
+       || read_unsigned_long(kf, &(exec_header->import_size_code)) == READ_ERROR
+       || read_unsigned_long(kf, &(exec_header->import_size_data)) == READ_ERROR
+       || read_unsigned_long(kf, &(exec_header->export_size_code)) == READ_ERROR
+       || read_unsigned_long(kf, &(exec_header->export_size_data)) == READ_ERROR
+       || read_unsigned_long(kf, &(exec_header->magic)) == READ_ERROR )
     return TRUNCATED_FILE; 
   if ( exec_header->magic == EXEC_MAGIC ) 
     return 0; 
@@ -365,24 +447,20 @@ read_exec_header(FILE* fd, struct exec_header * exec_header)
 }
 
 
-/* attempt_open: Leaves fd at the beginning of the code segment on success 
- * remember to close the returned file descriptor when the file has been
- * read. 
+/* attempt_open: Leaves kf at the beginning of the code segment on
+ * success; remember to close kf with kam_file_close and to free the
+ * main label of the header when the file has been read.
  */
 
 static int
-attempt_open(const char* restrict name, struct exec_header* restrict exec_header, serverstate ss, FILE **result) 
+attempt_open(const char* restrict name, struct exec_header* restrict exec_header, serverstate ss, KamFile *kf) 
 {
-  FILE *fd;
   int res;
 
   debug(printf("opening file %s\n", name));
-  fd = fopen(name, "r");
-  if ( fd == NULL ) {
-    die2("attempt_open: fopen returns NULL when trying to open file ", name);
-    exit(-1);
-  }
-  if ( (res = read_exec_header(fd, exec_header)) < 0 ) {
+  if ( (res = kam_file_open(name, kf)) == 0 )
+    res = read_exec_header(kf, exec_header);
+  if ( res < 0 ) {
     switch (res) {
     case FILE_NOT_FOUND:
       die2("attempt_open: cannot find the file ", name);
@@ -396,21 +474,71 @@ attempt_open(const char* restrict name, struct exec_header* restrict exec_header
     }
     exit(-1);
   }
-  *result = fd;
   return 0;
 }
 
+// unit: the i'th 32-bit unit of a code block
+static int32_t
+unit(const unsigned char* units, size_t i)
+{
+  int32_t u;
+  memcpy(&u, units + 4 * i, sizeof(int32_t));
+  return u;
+}
+
+/* loadCode: the code block of the file (n bytes) is a sequence of
+ * 32-bit units; each unit is loaded into a word of ch, so that the
+ * loaded code looks the same on 32-bit and 64-bit hosts, except for
+ * the size of a word. Immediates are sign-extended; string tags are
+ * not, and the characters of a string and the bytes of a real are
+ * copied as they are into the words that hold them. Offsets and
+ * addresses in the file count units and therefore also count the
+ * words of the loaded code. */
 static int 
-loadCode(FILE *fd, unsigned long n, bytecode_t ch) 
+loadCode(KamFile *kf, unsigned long n, bytecode_t ch) 
 {
-  int c;
-  while (n > 0) { 
-    if ( (c = fgetc(fd)) == EOF ) {
-      return -1; 
+  const unsigned char* units = kf->image + kf->pos;
+  uintptr_t* code = (uintptr_t*)ch;
+  size_t m = n / 4, i, j, str_sz;
+  int arity;
+
+  if ( kf->size - kf->pos < n || n % 4 != 0 )
+    return -1;
+  for ( i = 0 ; i < m ; i += arity + 1 ) {
+    code[i] = (uint32_t)unit(units, i);
+    arity = getInstArity(code[i]);
+    switch ( arity ) {
+    case -1:                                   // IMMED_STRING
+      if ( i + 1 >= m ) 
+	return -1;
+      code[i+1] = (uint32_t)unit(units, i+1);  // the tag
+      str_sz = get_string_size(code[i+1]) + 1; // zero-termination
+      arity = 1 + (str_sz + 3) / 4;
+      if ( i + arity >= m ) 
+	return -1;
+      memset(code + i + 2, 0, (arity - 1) * sizeof(uintptr_t));
+      memcpy(code + i + 2, units + 4 * (i + 2), str_sz);
+      continue;
+    case -2:                                   // JMP_VECTOR
+      if ( i + 3 >= m ) 
+	return -1;
+      arity = unit(units, i+3) + 3;
+      break;
+    default:
+      if ( arity < 0 )                         // not an instruction
+	return -1;
+    }
+    if ( i + arity >= m ) 
+      return -1;
+    if ( code[i] == IMMED_REAL ) {
+      memset(code + i + 1, 0, arity * sizeof(uintptr_t));
+      memcpy(code + i + 1, units + 4 * (i + 1), sizeof(double));
+      continue;
     }
-    *ch++ = (unsigned char)c;
-    n--; 
-  } 
+    for ( j = 1 ; j <= arity ; j++ )
+      code[i+j] = (intptr_t)unit(units, i+j);
+  }
+  kf->pos += n;
   return 0;
 }
 
@@ -418,11 +546,9 @@ loadCode(FILE *fd, unsigned long n, bytecode_t ch)
  *     *(start_code + relAddr) = labelMap[label]
  */
 
-#define PAIR_SIZE (2*sizeof(long))
-
 static int 
 resolveCodeImports(labelMap labelMap, 
-		   FILE* fd,
+		   KamFile* kf,
 		   unsigned long import_size,    // size is in entries
 		   bytecode_t start_code) 
 {	   
@@ -432,22 +558,18 @@ resolveCodeImports(labelMap labelMap,
   bytecode_t absSourceAddr;
 
   while ( import_size > 0 ) {
-    if ( read_unsigned_long(fd, &relAddr) == READ_ERROR
-	 || read_label(fd, &label) == READ_ERROR )
+    if ( read_unsigned_long(kf, &relAddr) == READ_ERROR
+	 || read_label_tmp(kf, &label) == READ_ERROR )
       return TRUNCATED_FILE;
 
     debug(printf("Importing relAddr = %d (0x%x), label = %d (0x%x) \n", 
 		 relAddr, relAddr, label, label));
 
     if ( (absTargetAddr = (bytecode_t)labelMapLookup(labelMap, label)) == 0 ) 
-      {
-	free(label);
-	return -4;
-      }
-    free(label);
-    absSourceAddr = start_code + relAddr;
-    * (unsigned long*)absSourceAddr = 
-      (unsigned long)(absTargetAddr - absSourceAddr);
+      return -4;
+    absSourceAddr = start_code + relAddr * sizeof(uintptr_t);
+    * (intptr_t*)absSourceAddr = 
+      (absTargetAddr - absSourceAddr) / (intptr_t)sizeof(uintptr_t);
     import_size --;
   }
   return 0;
@@ -455,7 +577,7 @@ resolveCodeImports(labelMap labelMap,
 
 static int 
 resolveDataImports(labelMap labelMap, 
-		   FILE* fd,
+		   KamFile* kf,
 		   unsigned long import_size,    // size is in entries
 		   bytecode_t start_code) 
 {	   
@@ -463,8 +585,8 @@ resolveDataImports(labelMap labelMap,
   label lab;
 
   while ( import_size > 0 ) {
-    if ( read_unsigned_long(fd, &relAddr) == READ_ERROR
-	 || read_label(fd, &lab) == READ_ERROR )
+    if ( read_unsigned_long(kf, &relAddr) == READ_ERROR
+	 || read_label_tmp(kf, &lab) == READ_ERROR )
       return TRUNCATED_FILE;
 
     debug(printf("Importing relAddr = %d (0x%x), label = %d (0x%x) \n", 
@@ -472,12 +594,9 @@ resolveDataImports(labelMap labelMap,
     debug_writer4("Importing relAddr = %d (0x%x), label = %d (0x%x) \n", 
 		 relAddr, relAddr, lab, lab);
 
-    if ( (dsAddr = labelMapLookup(labelMap, lab)) == 0 ) {
-      free(lab);
+    if ( (dsAddr = labelMapLookup(labelMap, lab)) == 0 )
       return -4;
-    }
-    free(lab);
-    * (unsigned long*)(start_code + relAddr) = dsAddr;
+    * (uintptr_t*)(start_code + relAddr * sizeof(uintptr_t)) = dsAddr;
     import_size --;
   }
   return 0;
@@ -488,7 +607,7 @@ resolveDataImports(labelMap labelMap,
  */
 static int
 addCodeExports(labelMap m, 
-	       FILE* fd, 
+	       KamFile* kf, 
 	       unsigned long export_size,     // size is in entries
 	       bytecode_t start_code) 
 {	   
@@ -497,19 +616,19 @@ addCodeExports(labelMap m,
   bytecode_t absAddr;
 
   while ( export_size > 0 ) {
-    if ( read_label(fd, &lab) == READ_ERROR )
+    if ( read_label(kf, &lab) == READ_ERROR )
       return TRUNCATED_FILE;
-    if ( read_unsigned_long(fd, &relAddr) == READ_ERROR )
+    if ( read_unsigned_long(kf, &relAddr) == READ_ERROR )
       {
 	free(lab);
 	return TRUNCATED_FILE;
       }
-    absAddr = start_code + relAddr;
+    absAddr = start_code + relAddr * sizeof(uintptr_t);
 
     debug(printf ("Reading export entry, label = %d (0x%x), relAddr = %d (0x%x), absAddr = %d (0x%x)\n", 
 		  lab, lab, relAddr, relAddr, absAddr, absAddr));
 
-    labelMapInsert(m, lab, (unsigned long)absAddr);
+    labelMapInsert(m, lab, (uintptr_t)absAddr);
     export_size --;
   }
   return 0;
@@ -517,16 +636,16 @@ addCodeExports(labelMap m,
 
 static int
 skipCodeExports(labelMap m, 
-	       FILE* fd, 
+	       KamFile* kf, 
 	       unsigned long export_size)     // size is in entries
 {	   
   unsigned long relAddr;
 
   while ( export_size > 0 )
   {
-    if ( skip_label(fd) == READ_ERROR )
+    if ( skip_label(kf) == READ_ERROR )
       return TRUNCATED_FILE;
-    if ( read_unsigned_long(fd, &relAddr) == READ_ERROR )
+    if ( read_unsigned_long(kf, &relAddr) == READ_ERROR )
     {
       return TRUNCATED_FILE;
     }
@@ -545,7 +664,7 @@ skipCodeExports(labelMap m,
 
 static int 
 addDataExports(Interp* interp, 
-	       FILE* fd, 
+	       KamFile* kf, 
 	       unsigned long export_size,  // size is in entries
 	       bytecode_t start_code)     
 {
@@ -553,10 +672,10 @@ addDataExports(Interp* interp,
   unsigned long relAddr, newDsAddr;
 
   while ( export_size > 0 ) {
-    if ( read_label(fd, &lab) == READ_ERROR )
+    if ( read_label(kf, &lab) == READ_ERROR )
       return TRUNCATED_FILE;
     // relAddr is the relative address of `StoreData lab' address in bytecode
-    if ( read_unsigned_long(fd, &relAddr) == READ_ERROR )
+    if ( read_unsigned_long(kf, &relAddr) == READ_ERROR )
       {
 	free(lab);
 	return TRUNCATED_FILE;
@@ -569,7 +688,7 @@ addDataExports(Interp* interp,
     debug_writer5("Export label = %d (0x%x), relAddr = %d (0x%x), newDsAddr = %d\n", 
 		 lab, lab, relAddr, relAddr, newDsAddr);
 
-    * (unsigned long*)(start_code + relAddr) = newDsAddr;
+    * (uintptr_t*)(start_code + relAddr * sizeof(uintptr_t)) = newDsAddr;
     labelMapInsert(interp->dataMap, lab, newDsAddr);
     export_size --;
   }
@@ -579,7 +698,7 @@ addDataExports(Interp* interp,
 /* alias data export labels with the garbage pointer */
 static int 
 garbageDataExports(Interp* interp, 
-	       FILE* fd, 
+	       KamFile* kf, 
 	       unsigned long export_size,  // size is in entries
 	       bytecode_t start_code)     
 {
@@ -587,10 +706,10 @@ garbageDataExports(Interp* interp,
 
   while ( export_size > 0 )
   {
-    if ( skip_label(fd) == READ_ERROR )
+    if ( skip_label(kf) == READ_ERROR )
       return TRUNCATED_FILE;
     // relAddr is the relative address of `StoreData lab' address in bytecode
-    if ( read_unsigned_long(fd, &relAddr) == READ_ERROR )
+    if ( read_unsigned_long(kf, &relAddr) == READ_ERROR )
     {
       return TRUNCATED_FILE;
     }
@@ -600,7 +719,7 @@ garbageDataExports(Interp* interp,
     debug_writer3("Garbage export label relAddr = %d (0x%x), newDsAddr = %d\n", 
 		               relAddr, relAddr, INTERP_INITIAL_DATASIZE -1);
 
-    * (unsigned long*)(start_code + relAddr) = INTERP_INITIAL_DATASIZE - 1;
+    * (uintptr_t*)(start_code + relAddr * sizeof(uintptr_t)) = INTERP_INITIAL_DATASIZE - 1;
     export_size --;
   }
   return 0;
@@ -608,28 +727,32 @@ garbageDataExports(Interp* interp,
 
 
 static bytecode_t 
-interpLoad(Interp* interp, const char* file, FILE* fd, 
+interpLoad(Interp* interp, const char* file, KamFile* kf, 
 	   struct exec_header* exec_header_ptr, serverstate ss) 
 {
   bytecode_t start_code;
 
   debug(print_exec_header(exec_header_ptr));
 
-  // allocate space for loaded code
-  if ( (start_code = (bytecode_t) malloc(exec_header_ptr->code_size)) == 0 ) 
+  // allocate space for loaded code; a word for each unit of the file
+  if ( (exec_header_ptr->code_size % 4) != 0 ) {
+    die2("interpLoad: Code size not a multiple of 4 for ", file);
+  }
+  if ( (start_code = (bytecode_t) malloc(exec_header_ptr->code_size / 4 
+					 * sizeof(uintptr_t))) == 0 ) 
     {
       die2("interpLoad: Cannot allocate start_code for ", file);
     }
 
   debug(printf("[Load code segment]\n"));
-  if ( loadCode(fd, exec_header_ptr->code_size, start_code) < 0 ) {
+  if ( loadCode(kf, exec_header_ptr->code_size, start_code) < 0 ) {
     die2("interpLoad: Cannot load code for ", file);
   }
 
   debug(printf("[Resolving code imports]\n"));
   /* Now, resolve the labels in the import table - 
    * first the code labels then the data labels */
-  if ( resolveCodeImports(interp->codeMap, fd, 
+  if ( resolveCodeImports(interp->codeMap, kf, 
 			  exec_header_ptr->import_size_code, 
 			  start_code) < 0 ) 
     {
@@ -637,7 +760,7 @@ interpLoad(Interp* interp, const char* file, FILE* fd,
     }
 
   debug(printf("[Resolving data imports]\n"));
-  if ( resolveDataImports(interp->dataMap, fd, 
+  if ( resolveDataImports(interp->dataMap, kf, 
 			  exec_header_ptr->import_size_data, 
 			  start_code) < 0 ) 
     {
@@ -646,15 +769,33 @@ interpLoad(Interp* interp, const char* file, FILE* fd,
 
 #ifdef LAB_THREADED
   debug(printf("[Resolving instructions]\n"));
-  if ( (exec_header_ptr->code_size % 4) != 0 ) {
-    die2("interpLoad: Code size not a multiple of 4 for ", file);
-  }
   resolveCode(start_code, exec_header_ptr->code_size / 4);
 #endif
 
   return start_code;
 }
 
+#if ( THREADS && CODE_CACHE )
+/* The resolved code of a leaf holds instruction addresses of the
+ * interpreter, relative offsets to the code of the libraries, and
+ * offsets in the data segment that depend on the libraries. The
+ * library key of an interpreter identifies the interpreter and the
+ * loaded library code (its addresses and content), so that leaf code
+ * in the shared arena (see SharedCode.h) is only used by processes in
+ * which it is valid, i.e., the children that inherited the libraries
+ * from the process that resolved the code. */
+static uintptr_t
+extendLibraryKey(uintptr_t key, bytecode_t code, size_t sizeW)
+{
+  size_t i;
+
+  key = key * 1000003 + (uintptr_t)code;
+  for ( i = 0 ; i < sizeW ; i++ )
+    key = key * 1000003 + ((uintptr_t*)code)[i];
+  return key;
+}
+#endif
+
 /* ------------------------------------------------------------  
  *  interpLoadExtend - load bytecode file and extend interpreter
  *  with information about the identifiers that this bytecode file
@@ -663,16 +804,16 @@ interpLoad(Interp* interp, const char* file, FILE* fd,
 int 
 interpLoadExtend(Interp* interp, const char* file, serverstate ss) 
 {
-  FILE *fd;
+  KamFile kf;
   struct exec_header exec_header;
   bytecode_t start_code;
 
-  attempt_open(file, &exec_header, ss, &fd);
+  attempt_open(file, &exec_header, ss, &kf);
 
-  start_code = interpLoad(interp, file, fd, &exec_header, ss);
+  start_code = interpLoad(interp, file, &kf, &exec_header, ss);
 
   debug(printf("[Extend hash table with code exports]\n"));
-  if ( addCodeExports(interp->codeMap, fd, 
+  if ( addCodeExports(interp->codeMap, &kf, 
 		      exec_header.export_size_code, 
 		      start_code) < 0 ) 
     {
@@ -680,20 +821,28 @@ interpLoadExtend(Interp* interp, const char* file, serverstate ss)
     }
 
   debug(printf("[Extend hash table with data exports]\n"));
-  if ( addDataExports(interp, fd, exec_header.export_size_data, 
+  if ( addDataExports(interp, &kf, exec_header.export_size_data, 
 		      start_code) < 0 ) 
     {
       die2("interpLoadExtend: Cannot extract data exports for ", file);
     }
   
-  fclose(fd);
+  kam_file_close(&kf);
+
+#if ( THREADS && CODE_CACHE )
+  interp->libraryKey = extendLibraryKey(interp->libraryKey, start_code,
+					exec_header.code_size / 4);
+#endif
 
   // extend the code list with the new code segment
   interp->codeList = listCons((unsigned long)start_code, interp->codeList);
 
   if ( exec_header.main_lab_opt->id == 0 
        && strcmp(&(exec_header.main_lab_opt->base),"") == 0 )
-    return 0;
+    {
+      free(exec_header.main_lab_opt);
+      return 0;
+    }
   else
     {
       unsigned long absAddr;       /* We need to look up this 
@@ -705,6 +854,7 @@ interpLoadExtend(Interp* interp, const char* file, serverstate ss)
 	       file);
 	}
       interp->exeList = listCons(absAddr, interp->exeList);
+      free(exec_header.main_lab_opt);
     }
   return 0;
 }
@@ -737,7 +887,7 @@ interpLoadExtend(Interp* interp, const char* file, serverstate ss)
  */
 
 #define INIT_CODE_SIZE 3
-static unsigned long init_code[INIT_CODE_SIZE] = {
+static uintptr_t init_code[INIT_CODE_SIZE] = {
   RETURN,0,1
 };
 
@@ -750,7 +900,7 @@ static unsigned long init_code[INIT_CODE_SIZE] = {
 // deallocate the global regions in this case.
  
 #define EXIT_CODE_SIZE 2
-static unsigned long exit_code[EXIT_CODE_SIZE] = {
+static uintptr_t exit_code[EXIT_CODE_SIZE] = {
   //  ENDREGION_INF,               // deallocate the four global regions
   //  ENDREGION_INF,
   //  ENDREGION_INF,
@@ -760,12 +910,12 @@ static unsigned long exit_code[EXIT_CODE_SIZE] = {
                                // content of the accumulator
 };
 
-static unsigned long global_exnhandler_closure[1] = {
+static uintptr_t global_exnhandler_closure[1] = {
   0   // place holder for code pointer
 };
   
 #define GLOBAL_EXNHANDLER_CODE_SIZE 2
-static unsigned long global_exnhandler_code[GLOBAL_EXNHANDLER_CODE_SIZE] = {
+static uintptr_t global_exnhandler_code[GLOBAL_EXNHANDLER_CODE_SIZE] = {
   GLOBAL_EXN_HANDLER_REPORT,   // sets acc to error (-1 or -2)
   //  POP_N, 3, 
   //  ENDREGION_INF,               // deallocate the four global regions
@@ -787,7 +937,7 @@ resolveGlobalCodeFragments(void)
   resolveCode((bytecode_t)global_exnhandler_code, 
 	      GLOBAL_EXNHANDLER_CODE_SIZE);
   // create closure (no env)
-  * global_exnhandler_closure = (unsigned long)global_exnhandler_code;    
+  * global_exnhandler_closure = (uintptr_t)global_exnhandler_code;    
 }
 
 ssize_t 
@@ -921,7 +1071,11 @@ ssize_t
 interpLoadRun(Interp* interp, const char* file, char** errorStr, serverstate ss, ssize_t *res) 
 {
   bytecode_t start_code;
-  FILE *fd;
+  KamFile kf;
+#if ( THREADS && CODE_CACHE )
+  SharedCodeId id;
+  int shared = 0;
+#endif
   debug_writer1("interpLoadRun %d starting\n", 0);
 
 #if ( THREADS && CODE_CACHE )
@@ -929,31 +1083,49 @@ interpLoadRun(Interp* interp, const char* file, char** errorStr, serverstate ss,
   LOCK_LOCK(CODECACHEMUTEX);
   debug_writer1("interpLoadRun %d find code\n", 0);
   start_code = strToCodeMapLookup(interp->codeCache,file);  
+  if ( start_code == NULL )
+    {
+      // perhaps another process has loaded the file
+      shared = sharedCodeMakeId(file, interp->libraryKey, &id) == 0;
+      if ( shared && (start_code = sharedCodeLookup(&id)) != NULL )
+	strToCodeMapInsert(interp->codeCache,file,start_code);
+    }
   if ( start_code == NULL )
     {
 #endif
       struct exec_header exec_header;
   debug_writer1("interpLoadRun %d open file\n", 0);
-      attempt_open(file, &exec_header, ss, &fd);
+      attempt_open(file, &exec_header, ss, &kf);
   debug_writer1("interpLoadRun %d load\n", 0);
-      start_code = interpLoad(interp, file, fd, &exec_header, ss);
+      start_code = interpLoad(interp, file, &kf, &exec_header, ss);
       debug(printf("[skip code exports]\n"));
-      if ( skipCodeExports(interp->codeMap, fd, 
+      if ( skipCodeExports(interp->codeMap, &kf, 
               exec_header.export_size_code) < 0 ) 
       {
         die2("interpLoadRun: Cannot extract code exports for ", file);
       }
 
       debug(printf("[alias data exports labels with garbage field]\n"));
-      if ( garbageDataExports(interp, fd, exec_header.export_size_data, 
+      if ( garbageDataExports(interp, &kf, exec_header.export_size_data, 
             start_code) < 0 ) 
       {
         die2("interpLoadRun: Cannot extract data exports for ", file);
       }
   debug_writer1("interpLoadRun %d close file\n", 0);
-      fclose(fd); // as we only read files we don't care about the return value
+      kam_file_close(&kf);
+      free(exec_header.main_lab_opt);
 #if ( THREADS && CODE_CACHE )
   debug_writer1("interpLoadRun %d insert code\n", 0);
+      if ( shared )
+	{
+	  bytecode_t shared_code;
+	  shared_code = sharedCodeInsert(&id, start_code, exec_header.code_size / 4);
+	  if ( shared_code != NULL )
+	    {
+	      free(start_code);
+	      start_code = shared_code;
+	    }
+	}
       strToCodeMapInsert(interp->codeCache,file,start_code);
       (*ss->report) (INFO, file,ss->aux);
     }
@@ -985,6 +1157,7 @@ interpClear(Interp* interp)
   interp->dataMap = labelMapClear(interp->dataMap);
 #if ( THREADS && CODE_CACHE )
   interp->codeCache = strToCodeMapClear(interp->codeCache);
+  interp->libraryKey = (uintptr_t)interpCode;
 #endif
   longListFreeElem(interp->codeList);
   interp->codeList = NULL;
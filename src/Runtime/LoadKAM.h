@@ -19,7 +19,11 @@
 			    export environment mapping labels 
 					to relative addresses
 	   end of file --->
-*/
+
+   All numbers of the file are 32 bits, little-endian. The code block
+   is a sequence of 32-bit units, which are loaded into words (see
+   loadCode in LoadKAM.c); jump offsets and relative addresses count
+   units. */
 
 // Comment out the following line to disable caching of leaf-bytecode (for SMLserver)
 #define CODE_CACHE 1
@@ -45,7 +49,7 @@ typedef Serverstate* serverstate;
 /* Compared to Moscow ML, we put the various information in front of the file. */
 
 struct exec_header {
-  unsigned long code_size;           /* Size of the code block (in bytes) */
+  unsigned long code_size;           /* Size of the code block in the file (in bytes) */
   label main_lab_opt;                /* Optional main label; (0,"") is NONE */
   unsigned long import_size_code;    /* Number of code import entries */
   unsigned long import_size_data;    /* Number of data import entries */
@@ -56,8 +60,8 @@ struct exec_header {
 
 #define HEADER_SIZE sizeof(struct exec_header)
 
-/* Magic number for this release: "K001" */
-#define EXEC_MAGIC 0x4b303031   
+/* Magic number for this release: "K002" */
+#define EXEC_MAGIC 0x4b303032   
 
 /* The type of loaded KAM code - each instruction takes 
  * up one word (i.e., a long) but we use a pointer to a 
@@ -118,6 +122,8 @@ typedef struct {
 			      * initialized by running some code. */
 #ifdef CODE_CACHE
   strToCodeMap codeCache;    /* Caching support for loaded leafs. */
+  uintptr_t libraryKey;      /* Identity of the loaded libraries; see
+			      * extendLibraryKey in LoadKAM.c. */
 #endif
   unsigned long data_size;   /* Accumulated size (in entries) of data segment */
 } Interp;
@@ -79,6 +79,11 @@ __div_int32ub(ssize_t x, ssize_t y, uintptr_t exn)                 /* ML */
   else return x / y;
 }
 
+/* Words of 32 bits are only passed to these functions by the
+ * bytecode interpreter, which keeps them sign-extended in a 64-bit
+ * word (see ofInt32 in Interp.c). */
+#define word32ub_result(w) ((size_t)(ssize_t)(int32_t)(w))
+
 size_t 
 __div_word32ub(size_t x, size_t y, uintptr_t exn)          /* ML */
 {
@@ -87,7 +92,7 @@ __div_word32ub(size_t x, size_t y, uintptr_t exn)          /* ML */
       raise_exn(exn);
       return 0;                               // never reached
     } 
-  return (x / y);
+  return word32ub_result((uint32_t)x / (uint32_t)y);
 }
 
 size_t 
@@ -141,7 +146,7 @@ __mod_word32ub(size_t x, size_t y, uintptr_t exn)
       raise_exn(exn);
       return 0;                              // never reached
     }
-  return (x % y);
+  return word32ub_result((uint32_t)x % (uint32_t)y);
 }
 
 size_t 
@@ -347,7 +347,7 @@ sml_readArr (size_t fd, char *base, size_t start, size_t length)
   return r;
 }
 
-int
+ssize_t
 sml_lseek (int fd, int p, int w)
 {
   int r;
@@ -5,7 +5,9 @@
 #ifndef _PRIMS_
 #define _PRIMS_
 
-typedef int (*c_primitive)();
+#include <stdint.h>
+
+typedef uintptr_t (*c_primitive)();
 extern c_primitive cprim[];
 
 #endif /* _PRIMS_ */
@@ -355,10 +355,10 @@ queueMarkProf(StringDesc *str, int pPoint)
 void 
 AllocatedSpaceInARegion(Ro *rp)
 { 
-  unsigned int n;
+  size_t n;
 
-  n = profTabGetNoOfPages(rp->regionId) * ALLOCATABLE_WORDS_IN_REGION_PAGE * 4;
-  fprintf(stderr,"    Allocated bytes in region %5zd: %5u\n",rp->regionId, n);
+  n = profTabGetNoOfPages(rp->regionId) * ALLOCATABLE_WORDS_IN_REGION_PAGE * sizeof(void *);
+  fprintf(stderr,"    Allocated bytes in region %5zd: %5zu\n",rp->regionId, n);
   return;
 }
 
@@ -486,11 +486,11 @@ printProfTab()
       maxAllocTot += maxAllocTab;
       /*      if (maxNoOfPagesTab)  */
 	fprintf(stderr,"    profTab[rId%5ld]: noOfPages = %8ld, maxNoOfPages = %8ld, allocNow = %8ld, maxAlloc = %8ld\n",
-		p->regionId, noOfPagesTab, maxNoOfPagesTab, allocNowTab*4, maxAllocTab*4);
+		p->regionId, noOfPagesTab, maxNoOfPagesTab, allocNowTab*(long)sizeof(void *), maxAllocTab*(long)sizeof(void *));
     }
   fprintf(stderr,      "    ---------------------------------------------------------------------------------------------------\n");
   fprintf(stderr,      "                          %8ld     SUM OF MAX: %8ld         Bytes: %8ld      Bytes: %8ld\n",
-	  noOfPagesTot, maxNoOfPagesTot, allocNowTot*4, maxAllocTot*4);
+	  noOfPagesTot, maxNoOfPagesTot, allocNowTot*(long)sizeof(void *), maxAllocTot*(long)sizeof(void *));
   fprintf(stderr,      "    ===================================================================================================\n");
 
 }
@@ -513,7 +513,7 @@ Statistics()
 	    (BYTES_ALLOC_BY_SBRK*callsOfSbrk)/Mb );
     
     fprintf(stderr,"\nREGION PAGES\n");
-    fprintf(stderr,"  Size of one page: %d bytes\n",ALLOCATABLE_WORDS_IN_REGION_PAGE*4);
+    fprintf(stderr,"  Size of one page: %d bytes\n",REGION_PAGE_SIZE);
     fprintf(stderr,"  Max number of allocated pages: %ld\n",maxNoOfPages);
     fprintf(stderr,"  Number of allocated pages now: %ld\n",noOfPages);
     fprintf(stderr,"  Max space for region pages: %ld bytes (%.1fMb)\n", 
@@ -553,7 +553,7 @@ Statistics()
     fprintf(stderr,"  Max space for finite regions: %ld bytes (%.1fMb)\n", maxAllocFin*(sizeof(void *)),
 	    (maxAllocFin*(sizeof(void *)))/Mb);
     fprintf(stderr,"  Max space for region descs: %ld bytes (%.1fMb)\n", 
-	    maxRegionDescUseInf*4, (maxRegionDescUseInf*(sizeof(void *)))/Mb);
+	    maxRegionDescUseInf*(sizeof(void *)), (maxRegionDescUseInf*(sizeof(void *)))/Mb);
     fprintf(stderr,"  Max size of stack: %ld bytes (%.1fMb)\n",
 	   ((long)stackBot)-((long)maxStack)-(maxProfStack*(sizeof(void *))), (((long)stackBot)-((long)maxStack)-(maxProfStack*(sizeof(void *))))/Mb);
     fprintf(stderr,"    incl. prof. info: %ld bytes (%.1fMb)\n", 
@@ -2,6 +2,14 @@
  *                        Regions                                 *
  *----------------------------------------------------------------*/
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef THREADS
+#include <pthread.h>
+#endif
 #include "Flags.h"
 #include "Region.h"
 #include "Math.h"
@@ -10,6 +18,7 @@
 #include "CommandLine.h"
 #include "Locks.h"
 #include "Runtime.h"
+#include "Tagging.h"
 
 /*
 #if defined(THREADS) && defined(AOLSERVER)
@@ -22,113 +31,149 @@ extern Ns_Mutex freelistMutex;
 #define FREELIST_MUTEX_UNLOCK
 #endif
 */
-/*----------------------------------------------------*
- * Hash table to collect region page reuse statistics *
- *  region_page_addr -> int                           *
- *----------------------------------------------------*/
-
-#if ( REGION_PAGE_STAT )
-
-RegionPageMap* 
-regionPageMapInsert(RegionPageMap* regionPageMap, unsigned int addr)
+/*----------------------------------------------------------------*
+ * Region page reuse statistics                                   *
+ *                                                                *
+ * With -region_page_stat n, the runtime system records, for a    *
+ * sample of the region pages, how many times each page is handed *
+ * out by get_free_page and the reuse distance of each handout:   *
+ * the number of pages handed out since the page was last handed  *
+ * out. Short distances mean that pages are reused while they are *
+ * still in the cache; see printRegionPageStats.                  *
+ *                                                                *
+ * A page is sampled if the hash of its page number is 0 modulo   *
+ * n (rounded up to a power of two); the clock only counts the    *
+ * handouts of sampled pages, so that distances measured on the   *
+ * clock are multiplied by n in the report. Sampled pages are     *
+ * kept in an open-addressed table of REGION_PAGE_STAT_SIZE       *
+ * entries, which is updated with atomic operations only, so that *
+ * the statistics can be collected in threaded (SMLserver)        *
+ * processes without taking FREELISTMUTEX. Handouts of sampled    *
+ * pages that do not fit in the table are counted in rps_dropped. *
+ *----------------------------------------------------------------*/
+typedef struct rpsEntry {
+  uintptr_t page;          /* page number (address / REGION_PAGE_SIZE), or 0 */
+  size_t uses;             /* number of times the page was handed out */
+  size_t last;             /* value of rps_clock when last handed out */
+} RpsEntry;
+
+#define RPS_PROBES 32      /* maximal number of entries probed */
+#define RPS_BUCKETS 40     /* buckets in the histograms; bucket i counts 
+			    * values v with 2^i <= v < 2^(i+1) */
+
+static RpsEntry *rps_table = NULL;
+static int rps_shift = 0;             /* log2 of the sampling interval */
+static size_t rps_clock = 0;          /* handouts of sampled pages */
+static size_t rps_dropped = 0;        /* handouts of pages not in the table */
+static size_t rps_dist[RPS_BUCKETS];  /* histogram of reuse distances */
+
+static inline uintptr_t
+rps_hash(uintptr_t page)
 {
-  int index;
-  RegionPageMapHashList* newElem;
-
-  newElem = (RegionPageMapHashList*)malloc(sizeof(RegionPageMapHashList));
-  if ( newElem == NULL ) {
-    die("regionPageMapInsert error");
-  }
-
-  newElem->n = 1;
-  newElem->addr = addr;
-
-  index = hashRegionPageIndex(addr);
-  newElem->next = regionPageMap[index];
-
-  regionPageMap[index] = newElem;
-  return regionPageMap;    /* We want to allow for hash-table 
-			    * resizing in the future */
-}  
+  uintptr_t h = page * (uintptr_t)0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> (4 * sizeof(uintptr_t)));
+}
 
-/* Create and allocate space for a new regionPageMapHashTable */
-void 
-regionPageMapZero(RegionPageMap* regionPageMap)
+static inline int
+rps_bucket(size_t v)
 {
-  int i;
-  for ( i = 0 ; i < REGION_PAGE_MAP_HASH_TABLE_SIZE ; i++ ) 
-    {
-      regionPageMap[i] = NULL;
-    }
+  int i = 0;
+  while ( v >>= 1 )
+    i++;
+  return i < RPS_BUCKETS ? i : RPS_BUCKETS - 1;
 }
 
-RegionPageMap* 
-regionPageMapNew(void) 
+/* Apache runs post_config again on a restart; the table (and the
+ * counts in it) is kept from the first call. */
+void
+regionPageStatInit(long n)
 {
-  RegionPageMap* regionPageMap;
-
-  regionPageMap = (RegionPageMap*)malloc(sizeof(void *) * REGION_PAGE_MAP_HASH_TABLE_SIZE);
-  if ( regionPageMap == NULL ) {
-    die("Unable to allocate memory for RegionPageMapHashTable");
-  }
-
-  regionPageMapZero(regionPageMap);
-  return regionPageMap;
+  if ( rps_table )
+    return;
+  while ( ((long)1 << rps_shift) < n )
+    rps_shift++;
+  rps_table = (RpsEntry *)calloc(REGION_PAGE_STAT_SIZE, sizeof(RpsEntry));
+  if ( rps_table == NULL )
+    die("regionPageStatInit: calloc returned NULL");
 }
 
-RegionPageMap*
-regionPageMapIncr(RegionPageMap* regionPageMap, unsigned int addr)
+static void
+rps_record(Rp *rp)
 {
-  RegionPageMapHashList* p;
-  for ( p = regionPageMap[hashRegionPageIndex(addr)]; p != NULL ; p = p->next ) 
+  uintptr_t page = (uintptr_t)rp / REGION_PAGE_SIZE;
+  uintptr_t h = rps_hash(page);
+  size_t i, now, prev;
+  RpsEntry *e = NULL;
+
+  if ( h & (((uintptr_t)1 << rps_shift) - 1) )
+    return;
+  now = __sync_add_and_fetch(&rps_clock, 1);
+  for ( i = 0 ; i < RPS_PROBES ; i++ )
     {
-      if ( p->addr == addr ) 
-	{
-	  p->n++;
-	  return regionPageMap;
-	}
+      e = &rps_table[((h >> rps_shift) + i) & (REGION_PAGE_STAT_SIZE - 1)];
+      if ( e->page == 0 )
+	__sync_bool_compare_and_swap(&e->page, 0, page);
+      if ( e->page == page )
+	break;
     }
-  return regionPageMapInsert(regionPageMap,addr);
-}  
-
-uintptr_t
-regionPageMapLookup(RegionPageMap* regionPageMap, uintptr_t addr)
-{
-  RegionPageMapHashList* p;
-  for ( p = regionPageMap[hashRegionPageIndex(addr)]; p != NULL ; p = p->next ) 
+  if ( i == RPS_PROBES )
     {
-      if ( p->addr == addr ) 
-	{
-	  return p->n;
-	}
+      __sync_fetch_and_add(&rps_dropped, 1);
+      return;
     }
-  return (uintptr_t) NULL;
+  __sync_fetch_and_add(&e->uses, 1);
+  prev = __sync_lock_test_and_set(&e->last, now);
+  if ( prev )
+    __sync_fetch_and_add(&rps_dist[rps_bucket(now - prev)], 1);
 }
 
 void
-regionPageMapClear(RegionPageMap* regionPageMap)
+printRegionPageStats(void)
 {
-  int i;
-  RegionPageMapHashList *p, *n;
+  size_t uses[RPS_BUCKETS] = { 0 };
+  size_t i, pages = 0, handouts = 0, reuses = 0, acc = 0, warm = 0;
+  size_t n = (size_t)1 << rps_shift;
 
-  for ( i = 0 ; i < REGION_PAGE_MAP_HASH_TABLE_SIZE ; i++ ) 
+  if ( rps_table == NULL )
+    return;
+  for ( i = 0 ; i < REGION_PAGE_STAT_SIZE ; i++ )
+    if ( rps_table[i].page )
+      {
+	pages++;
+	handouts += rps_table[i].uses;
+	uses[rps_bucket(rps_table[i].uses)]++;
+      }
+  for ( i = 0 ; i < RPS_BUCKETS ; i++ )
     {
-      p = regionPageMap[i];
-      while ( p )
-	{
-	  n = p->next;
-	  free(p);
-	  p = n;
-	}
-      regionPageMap[i] = 0;
+      reuses += rps_dist[i];
+      if ( (n << (i+1)) * REGION_PAGE_SIZE <= REGION_PAGE_STAT_WARM )
+	warm += rps_dist[i];
     }
-}
 
-RegionPageMap* rpMap = NULL;
-#define REGION_PAGE_MAP_INCR(rp) (regionPageMapIncr(rpMap,(unsigned int)(rp)));
-#else
-#define REGION_PAGE_MAP_INCR(rp) 
-#endif /* REGION_PAGE_STAT */
+  fprintf(stderr, "\nRegion page reuse statistics (1 in %zu pages sampled):\n", n);
+  fprintf(stderr, "  Pages sampled:               %zu\n", pages);
+  fprintf(stderr, "  Handouts of sampled pages:   %zu (%zu dropped; table full)\n", 
+	  handouts, rps_dropped);
+  fprintf(stderr, "  Reuses:                      %zu (%.1f%% of handouts)\n", 
+	  reuses, handouts ? 100.0 * reuses / handouts : 0.0);
+  fprintf(stderr, "  Reuses within %d Kb of page traffic: %.1f%%\n", 
+	  REGION_PAGE_STAT_WARM / 1024, reuses ? 100.0 * warm / reuses : 0.0);
+  fprintf(stderr, "  Handouts per page:\n");
+  for ( i = 0 ; i < RPS_BUCKETS ; i++ )
+    if ( uses[i] )
+      fprintf(stderr, "    %10zu - %-10zu %10zu pages\n", 
+	      (size_t)1 << i, ((size_t)2 << i) - 1, uses[i]);
+  fprintf(stderr, "  Reuse distance (pages handed out in between, estimated):\n");
+  for ( i = 0 ; i < RPS_BUCKETS ; i++ )
+    if ( rps_dist[i] )
+      {
+	acc += rps_dist[i];
+	fprintf(stderr, "    %10zu - %-10zu %10zu reuses %6.1f%% cumulative (< %zu Kb)\n", 
+		n << i, (n << (i+1)) - 1, rps_dist[i], 100.0 * acc / reuses,
+		(n << (i+1)) * REGION_PAGE_SIZE / 1024);
+      }
+  return;
+}
 
 /*----------------------------------------------------------------*
  * Global declarations                                            *
@@ -140,9 +185,332 @@ Ro * topRegion;
 #endif
 
 #ifdef ENABLE_GC
-int rp_used = 0;
+long rp_used = 0;
 #endif /* ENABLE_GC */
-int rp_total = 0;
+long rp_total = 0;
+
+static void fill_pool(Rp **pool, int node);
+
+/*----------------------------------------------------------------*
+ * Region statistics                                              *
+ *                                                                *
+ * Unlike the profiling counters below, these counters are kept   *
+ * in all builds and are cheap enough for production use. Region  *
+ * and large object counts are kept per thread, without locking,  *
+ * and summed when regionStats is called; the counters of a       *
+ * thread are registered in rs_all when the thread first updates  *
+ * them and are never freed, so that the counts of terminated     *
+ * threads are included. Page counts are global and are updated   *
+ * where FREELISTMUTEX is held anyway; pages in the magazine of a *
+ * thread count as pages in use.                                  *
+ *----------------------------------------------------------------*/
+typedef struct rsCounters {
+  size_t regionAllocs;         /* infinite regions allocated */
+  size_t regionDeallocs;       /* infinite regions deallocated */
+  size_t regionResets;         /* calls of resetRegion */
+  long lobjBytes;              /* bytes in large object blocks allocated less
+				* bytes freed; may be negative for a thread */
+  struct rsCounters *next;     /* the counters of another thread */
+} RsCounters;
+
+#ifdef THREADS
+static RsCounters *rs_all = NULL;
+static __thread RsCounters *rs_thread = NULL;
+
+static RsCounters *
+rs_register(void)
+{
+  RsCounters *c = (RsCounters *)calloc(1, sizeof(RsCounters));
+  if ( c == NULL )
+    die("rs_register: calloc returned NULL");
+  do c->next = rs_all;
+  while ( ! __sync_bool_compare_and_swap(&rs_all, c->next, c) );
+  return rs_thread = c;
+}
+
+#define rs_counters() (rs_thread ? rs_thread : rs_register())
+#else
+static RsCounters rs_main = { 0, 0, 0, 0, NULL };
+static RsCounters *rs_all = &rs_main;
+
+#define rs_counters() (&rs_main)
+#endif /* THREADS */
+
+/*----------------------------------------------------------------*
+ * Free page accounting                                           *
+ *                                                                *
+ * rp_free is the number of pages in the freelist and in the node *
+ * pools; it is protected by FREELISTMUTEX and is kept exact, so   *
+ * that size_free_list and the GC trigger in alloc_new_block need *
+ * not walk the freelist. Pages in the magazine of a thread are   *
+ * counted in rpMagazine.n. rp_total - rp_free is the number of   *
+ * pages in use (including pages in magazines); rp_out_max is its *
+ * high-water mark.                                               *
+ *----------------------------------------------------------------*/
+static size_t rp_free = 0;
+static size_t rp_out_max = 0;
+
+#define rp_out() ((size_t)rp_total - rp_free)
+#define rp_free_take(k) { rp_free -= (k); if ( rp_out() > rp_out_max ) rp_out_max = rp_out(); }
+
+/*----------------------------------------------------------------*
+ * Per-thread region page magazines                               *
+ *                                                                *
+ * With THREADS, every thread keeps a magazine of free region     *
+ * pages in front of the global freelist. Pages are taken from    *
+ * and returned to the magazine without locking; FREELISTMUTEX is *
+ * only taken when a magazine is refilled from the freelist (one  *
+ * batch of REGION_PAGE_MAGAZINE_BATCH pages) or when a magazine  *
+ * overflows, in which case the magazine and the chain being      *
+ * freed are spliced onto the freelist in one go.                 *
+ *                                                                *
+ * When a thread that has used its magazine terminates, the      *
+ * pages in the magazine are returned to the freelist by the      *
+ * destructor of rpMagazineKey (see magazine_pool).               *
+ *----------------------------------------------------------------*/
+#ifdef THREADS
+typedef struct rpMagazine {
+  Rp *first;       /* NULL or the first page in the magazine */
+  Rp *last;        /* the last page in the magazine, if first != NULL */
+  size_t n;        /* number of pages in the magazine */
+  Rp **pool;       /* the freelist of the node of the thread, or NULL 
+		    * if the thread has not been assigned a node yet */
+  int node;        /* the node of the thread, if pool != NULL */
+} RpMagazine;
+
+static __thread RpMagazine rpMagazine = { NULL, NULL, 0, NULL, 0 };
+static pthread_key_t rpMagazineKey;
+static pthread_once_t rpMagazineKeyOnce = PTHREAD_ONCE_INIT;
+
+static void
+rpMagazineExit(void *unused)
+{
+  flushRegionPageCache();
+}
+
+static void
+rpMagazineKeyCreate(void)
+{
+  if ( pthread_key_create(&rpMagazineKey, rpMagazineExit) != 0 )
+    die("rpMagazineKeyCreate: pthread_key_create failed");
+}
+
+/*----------------------------------------------------------------*
+ * NUMA page pools                                                *
+ *                                                                *
+ * With -region_numa, free region pages are kept in a pool for    *
+ * each NUMA node: pool 0 is the freelist and the pools of the    *
+ * other nodes are in node_freelist. A thread is assigned the     *
+ * node of the CPU it runs on when it first needs a page, and     *
+ * its magazine is refilled from, and overflows into, the pool of *
+ * that node. New chunks for a pool are carved from arenas bound  *
+ * to the node (see reserve_arena). Pages freed by a thread go to *
+ * the pool of that thread, even if they were taken by a thread   *
+ * on another node. Machines with more than REGION_NUMA_MAX_NODES *
+ * nodes share pools between nodes.                               *
+ *                                                                *
+ * With -region_numa_sim n, threads are assigned to n simulated   *
+ * nodes round-robin and arenas are not bound, so that the pools  *
+ * can be exercised on a machine with a single node. Without      *
+ * either flag, all threads use the freelist.                     *
+ *                                                                *
+ * The pools are protected by FREELISTMUTEX.                      *
+ *----------------------------------------------------------------*/
+static Rp *node_freelist[REGION_NUMA_MAX_NODES];  /* entry 0 is unused */
+
+#define node_pool(node) ((node) ? &node_freelist[node] : &freelist)
+
+static unsigned int
+cpu_node(void)
+{
+#ifdef SYS_getcpu
+  unsigned int cpu, node;
+  if ( syscall(SYS_getcpu, &cpu, &node, NULL) == 0 )
+    return node;
+#endif
+  return 0;
+}
+
+static int
+thread_node(void)
+{
+  static unsigned int next_node = 0;
+  unsigned int node = 0;
+
+  if ( region_numa_nodes > 0 )
+    node = __sync_fetch_and_add(&next_node, 1) % region_numa_nodes;
+  else if ( region_numa_nodes < 0 )
+    node = cpu_node();
+  return node % REGION_NUMA_MAX_NODES;
+}
+
+/* The pool of the calling thread; assigns the thread a node if
+ * it does not have one yet. Every path that puts pages in the
+ * magazine passes through here first, so this is also where the
+ * magazine is registered to be flushed when the thread exits. */
+static inline Rp **
+magazine_pool(void)
+{
+  if ( rpMagazine.pool == NULL )
+    {
+      rpMagazine.node = thread_node();
+      rpMagazine.pool = node_pool(rpMagazine.node);
+      pthread_once(&rpMagazineKeyOnce, rpMagazineKeyCreate);
+      pthread_setspecific(rpMagazineKey, &rpMagazine);
+    }
+  return rpMagazine.pool;
+}
+
+int
+regionPageNode(void)
+{
+  magazine_pool();
+  return rpMagazine.node;
+}
+
+/* Move up to REGION_PAGE_MAGAZINE_BATCH pages from the pool of the
+ * calling thread into the (empty) magazine of the thread. */
+static void
+refill_magazine(void)
+{
+  Rp **pool = magazine_pool();
+  Rp *rp;
+  size_t n;
+
+  LOCK_LOCK(FREELISTMUTEX);
+  if ( *pool == NULL ) fill_pool(pool, rpMagazine.node);
+  rp = *pool;
+  for ( n = 1 ; n < REGION_PAGE_MAGAZINE_BATCH && rp->n ; n++ )
+    rp = rp->n;
+  rpMagazine.first = *pool;
+  rpMagazine.last = rp;
+  rpMagazine.n = n;
+  *pool = rp->n;
+  rp_free_take(n);
+  LOCK_UNLOCK(FREELISTMUTEX);
+
+  rp->n = NULL;
+  return;
+}
+
+void
+flushRegionPageCache(void)
+{
+  if ( rpMagazine.first == NULL )
+    return;
+  LOCK_LOCK(FREELISTMUTEX);
+  rpMagazine.last->n = *rpMagazine.pool;
+  *rpMagazine.pool = rpMagazine.first;
+  rp_free += rpMagazine.n;
+  LOCK_UNLOCK(FREELISTMUTEX);
+  rpMagazine.first = rpMagazine.last = NULL;
+  rpMagazine.n = 0;
+  return;
+}
+#else
+void
+flushRegionPageCache(void)
+{
+  return;
+}
+
+int
+regionPageNode(void)
+{
+  return 0;
+}
+#endif /* THREADS */
+
+static size_t rp_trim_countdown = REGION_TRIM_INTERVAL;
+static void trim_freelist(Rp **pool);
+static Lobjs *lobj_block_alloc(size_t sz_bytes);
+static inline void lobj_block_free(Lobjs *lobjs);
+
+/* Get a free region page, either from the magazine of the calling
+ * thread or from the global freelist. */
+static inline Rp *
+get_free_page(void)
+{
+  Rp *np;
+
+#ifdef THREADS
+  if ( rpMagazine.first == NULL )
+    refill_magazine();
+  np = rpMagazine.first;
+  rpMagazine.first = np->n;
+  rpMagazine.n--;
+#else
+  LOCK_LOCK(FREELISTMUTEX);
+  if ( freelist == NULL ) callSbrk();
+  np = freelist;
+  freelist = freelist->n;
+  rp_free_take(1);
+  LOCK_UNLOCK(FREELISTMUTEX);
+#endif /* THREADS */
+
+  if ( rps_table )
+    rps_record(np);
+  return np;
+}
+
+/* Return the chain of region pages first..last (linked through the
+ * n-fields) to the magazine of the calling thread or to the global
+ * freelist. Chains that do not fit in the magazine are spliced onto
+ * the freelist together with the current content of the magazine, so
+ * the walk that decides whether the chain fits is bounded by the
+ * magazine size. The pages of the chain are counted in full only when
+ * the chain is spliced onto the freelist, which keeps the free page
+ * count and the trim countdown exact. */
+static inline void
+free_page_chain(Rp *first, Rp *last)
+{
+  Rp *rp = first;
+  size_t n = 1;
+#ifdef THREADS
+  Rp **pool = magazine_pool();
+  size_t room = REGION_PAGE_MAGAZINE_SIZE - rpMagazine.n;
+
+  for ( ; rp != last && n <= room ; rp = rp->n )
+    n++;
+
+  if ( n <= room )
+    {
+      last->n = rpMagazine.first;
+      if ( rpMagazine.first == NULL )
+	rpMagazine.last = last;
+      rpMagazine.first = first;
+      rpMagazine.n += n;
+      return;
+    }
+#else
+  Rp **pool = &freelist;
+#endif /* THREADS */
+
+  for ( ; rp != last ; rp = rp->n )
+    n++;
+
+#ifdef THREADS
+  if ( rpMagazine.first )
+    {
+      rpMagazine.last->n = first;
+      first = rpMagazine.first;
+      n += rpMagazine.n;
+      rpMagazine.first = rpMagazine.last = NULL;
+      rpMagazine.n = 0;
+    }
+#endif /* THREADS */
+
+  LOCK_LOCK(FREELISTMUTEX);
+  last->n = *pool;
+  *pool = first;
+  rp_free += n;
+  if ( rp_trim_countdown <= n )
+    trim_freelist(pool);
+  else
+    rp_trim_countdown -= n;
+  LOCK_UNLOCK(FREELISTMUTEX);
+  return;
+}
 
 #ifdef PROFILING
 FiniteRegionDesc * topFiniteRegion = NULL;
@@ -350,19 +718,20 @@ printFreeList()
 
 
 #ifdef ENABLE_GC
+/* The number of free region pages; see rp_free. */
 size_t 
 size_free_list() 
 {
-  Rp *rp;
-  size_t i=0;
+  size_t i;
 
   LOCK_LOCK(FREELISTMUTEX);
-
-  for ( rp = freelist ; rp ; rp = rp-> n )
-    i++;
-
+  i = rp_free;
   LOCK_UNLOCK(FREELISTMUTEX);
 
+#ifdef THREADS
+  i += rpMagazine.n;   // pages cached by the calling thread
+#endif /* THREADS */
+
   return i;
 }
 #endif /*ENABLE_GC*/
@@ -404,6 +773,16 @@ alloc_new_block(Gen *gen)
   rp_used++;
   if ( (!disable_gc) && (!time_to_gc) ) 
     {
+#ifdef ENABLE_GEN_GC
+      // with -gc_max_pause_us, collect the young generations when
+      // enough pages have been allocated (see adjust_young_limit in GC.c)
+      rp_young++;
+      if ( rp_young_limit && rp_young > rp_young_limit )
+	{
+	  time_to_gc = 1;
+	  gc_trigger = GC_TRIGGER_YOUNG;
+	}
+#endif /* ENABLE_GEN_GC */
       // the treshold suggests when we can garbage collect without allocating 
       // more memory.
       //      double treshold = (double)rp_total - (((double)rp_total) / heap_to_live_ratio);
@@ -412,22 +791,16 @@ alloc_new_block(Gen *gen)
 	  // calculate correct value for rp_used; the current value may exceed the correct
 	  // value due to conservative computation in resetRegion, deallocRegion...
 	  rp_used = rp_total - size_free_list();
-	  if ( rp_used > rp_gc_treshold )
+	  if ( rp_used > rp_gc_treshold && !time_to_gc )
 	    {
 	      time_to_gc = 1;
+	      gc_trigger = GC_TRIGGER_HEAP;
 	    }
 	}
     }
   #endif /* ENABLE_GC */
 
-  LOCK_LOCK(FREELISTMUTEX);
-  if ( freelist == NULL ) callSbrk(); 
-  np = freelist;
-  freelist = freelist->n;
-
-  REGION_PAGE_MAP_INCR(np); // update frequency hashtable
-
-  LOCK_UNLOCK(FREELISTMUTEX);
+  np = get_free_page();
 
 #ifdef ENABLE_GEN_GC
   // update colorPtr so that all new objects are considered to be in
@@ -496,6 +869,7 @@ allocateRegion0(Region r
   r->p = TOP_REGION;	         // Push this region onto the region stack
   r->lobjs = NULL;               // The list of large objects is empty
   alloc_new_block(&(r->g0));     // Allocate the first region page in g0
+  rs_counters()->regionAllocs++;
 #ifdef ENABLE_GEN_GC
   r->g1.fp = NULL;
   set_gen_1(r->g1);              // Mark generation
@@ -572,18 +946,35 @@ allocateTripleRegion(Region r)
   r = (Region)setInfiniteBit((uintptr_t)r);
   return r;
 }
+
+/* The compiler allocates a letregion-bound region with
+   allocateStringRegion if region inference has found that the region
+   holds strings only. As the values of a string region contain no
+   pointers, the garbage collector may leave them in place (see
+   GC_STRING_REGION_PERIOD). */
+Region 
+allocateStringRegion(Region r)
+{
+  r = allocateRegion0(r);
+  set_stringregion(r->g0);
+#ifdef ENABLE_GEN_GC
+  set_stringregion(r->g1);
+#endif /* ENABLE_GEN_GC */
+  r = (Region)setInfiniteBit((uintptr_t)r);
+  return r;
+}
 #endif /*ENABLE_GC*/
 
-void free_lobjs(Lobjs* lobjs)
+/* Free the large objects in the list lobjs; FREELISTMUTEX must be held. */
+static void
+free_lobj_list(Lobjs* lobjs)
 {
-  //if ( lobjs )
-  //  fprintf(stderr, "Freeing large objs: lobjs=%p\n", lobjs);
   while ( lobjs ) 
     {
       Lobjs* lobjsTmp;
 
 #ifdef ENABLE_GC
-      unsigned int tag;
+      uintptr_t tag;
   #ifdef PROFILING
       tag = *((&(lobjs->value)) + sizeObjectDesc);
   #else
@@ -593,15 +984,22 @@ void free_lobjs(Lobjs* lobjs)
       lobjs_current -= size_lobj(tag);
 #endif	  
       lobjsTmp = clear_lobj_bit(lobjs->next);
-#ifdef ENABLE_GC
-      free(lobjs->orig);
-#else
-      free(lobjs);
-#endif
+      lobj_block_free(lobjs);
       lobjs = lobjsTmp;
     }
 }
 
+void free_lobjs(Lobjs* lobjs)
+{
+  //if ( lobjs )
+  //  fprintf(stderr, "Freeing large objs: lobjs=%p\n", lobjs);
+  if ( lobjs == NULL )
+    return;
+  LOCK_LOCK(FREELISTMUTEX);
+  free_lobj_list(lobjs);
+  LOCK_UNLOCK(FREELISTMUTEX);
+}
+
 /*----------------------------------------------------------------------*
  *deallocateRegion:                                                     *
  *  Pops the top region of the stack, and insert the regionpages in the *
@@ -636,17 +1034,16 @@ void deallocateRegion(
   #endif /* ENABLE_GC */
 
   free_lobjs(TOP_REGION->lobjs);
+  rs_counters()->regionDeallocs++;
 
   /* Insert the region pages in the freelist; there is always 
    * at least one page in a generation. */  
-  LOCK_LOCK(FREELISTMUTEX);
-  (((Rp *)TOP_REGION->g0.b)-1)->n = freelist;  // Free pages in generation 0
-  freelist = clear_fp(TOP_REGION->g0.fp);
+  free_page_chain(clear_fp(TOP_REGION->g0.fp),      // Free pages in generation 0
+		  ((Rp *)TOP_REGION->g0.b)-1);
 #ifdef ENABLE_GEN_GC
-  (((Rp *)TOP_REGION->g1.b)-1)->n = freelist;  // Free pages in generation 1
-  freelist = clear_fp(TOP_REGION->g1.fp);
+  free_page_chain(clear_fp(TOP_REGION->g1.fp),      // Free pages in generation 1
+		  ((Rp *)TOP_REGION->g1.b)-1);
 #endif /* ENABLE_GEN_GC */
-  LOCK_UNLOCK(FREELISTMUTEX);
 
   TOP_REGION=TOP_REGION->p;
 
@@ -655,88 +1052,573 @@ void deallocateRegion(
   return;
 }
 
+#ifndef PROFILING
+/*----------------------------------------------------------------------*
+ *deallocateRegionsBatch:                                               *
+ *  Pops the regions from the top of the stack down to (but excluding)  *
+ *  the region stop. Instead of freeing each region separately, as      *
+ *  deallocateRegion does, the page chains of the regions are linked    *
+ *  together and inserted in the free list in one go, and the large     *
+ *  objects of all the regions are freed while holding the lock once.   *
+ *  Used when an exception unwinds many regions at a time.              *
+ *----------------------------------------------------------------------*/
+static void
+deallocateRegionsBatch(Ro *stop
+#ifdef KAM
+		       , Region* topRegionCell
+#endif
+		       )
+{
+  Ro *r;
+  Rp *first = NULL, *last = NULL;
+  size_t chains = 0, regions = 0;
+  int locked = 0;
+
+  for ( r = TOP_REGION ; r != stop ; r = r->p )
+    {
+      if ( r->lobjs )
+	{
+	  if ( ! locked )
+	    {
+	      LOCK_LOCK(FREELISTMUTEX);
+	      locked = 1;
+	    }
+	  free_lobj_list(r->lobjs);
+	}
+
+      /* Link the pages in front of the chain; there is always
+       * at least one page in a generation. */
+      (((Rp *)r->g0.b)-1)->n = first;
+      if ( first == NULL ) 
+	last = ((Rp *)r->g0.b)-1;
+      first = clear_fp(r->g0.fp);
+      chains++;
+      regions++;
+#ifdef ENABLE_GEN_GC
+      (((Rp *)r->g1.b)-1)->n = first;
+      first = clear_fp(r->g1.fp);
+      chains++;
+#endif /* ENABLE_GEN_GC */
+    }
+  if ( locked )
+    LOCK_UNLOCK(FREELISTMUTEX);
+
+  if ( first )
+    {
+      #ifdef ENABLE_GC
+      rp_used -= chains;    // MIN_NO_OF_PAGES_IN_REGION per region
+      #endif /* ENABLE_GC */
+      free_page_chain(first, last);
+    }
+  rs_counters()->regionDeallocs += regions;
+
+  TOP_REGION = stop;
+}
+#endif /* PROFILING */
+
 inline static Lobjs *
 alloc_lobjs(int n) {
   Lobjs* lobjs;
-#ifdef ENABLE_GC
-  char *p;
-  size_t r;  
-  size_t sz_bytes;
-  sz_bytes = 4*n + sizeof(Lobjs) + 1024;
-  p = malloc(sz_bytes);
-  if ( p == NULL )
-    die("alloc_lobjs: malloc returned NULL");
-  if ( (r = (size_t)p % 1024) ) {
-    lobjs = (Lobjs*)(p + 1024 - r);
-  } else {
-    lobjs = (Lobjs*)p;
-  }
-  //fprintf(stderr, "Allocated large obj: p=%p; r=%x; lobjs=%p; last_byte=%p; sz_bytes=%d\n", p, r, lobjs, p + sz_bytes, sz_bytes);
+  lobjs = lobj_block_alloc(n * sizeof(uintptr_t) + sizeof(Lobjs));
+  //fprintf(stderr, "Allocated large obj: lobjs=%p; n=%d\n", lobjs, n);
   if ( ! is_rp_aligned((size_t)lobjs) )
     die("alloc_lobjs: large object is not properly aligned.");
-  lobjs->orig = p;
-#else
-  lobjs = (Lobjs*)malloc(4*n + sizeof(Lobjs));
-  if ( lobjs == NULL )
-    die("alloc_lobjs: malloc returned NULL");
-#endif /* ENABLE_GC */
 #ifdef KAM
-  lobjs->sizeOfLobj = 4*n;
+  lobjs->sizeOfLobj = n*sizeof(uintptr_t);
+#endif
+  return lobjs;
+}
+
+/*----------------------------------------------------------------------*
+ * Region page arena                                                    *
+ *                                                                      *
+ * Where mmap is available, region pages are carved from a large        *
+ * virtual range reserved with mmap instead of from malloc'ed bags.     *
+ * The range (of region_arena_mb Mb; see CommandLine.c) is aligned to   *
+ * REGION_ARENA_ALIGN so that the kernel may back it with huge pages.   *
+ * Memory is only committed when a page is first touched. When an       *
+ * arena is exhausted, a new one is reserved; if a reservation fails,   *
+ * or if region_arena_mb is 0, callSbrk falls back to malloc.           *
+ * There is a current arena for each node (see NUMA page pools above); *
+ * with -region_numa, the arenas of a node are bound to the node.       *
+ * The arena variables are protected by FREELISTMUTEX, as callSbrk is.  *
+ *                                                                      *
+ * An arena is handed out in chunks of BYTES_ALLOC_BY_SBRK bytes. When  *
+ * the freelist holds more than region_keep_pages pages, trim_freelist *
+ * returns chunks whose pages are all free to the operating system     *
+ * (with madvise), as lobj_block_free does with chunks of free large    *
+ * object blocks; such chunks are reused by get_chunk before new space  *
+ * is carved from an arena. Pages obtained with malloc are never        *
+ * returned.                                                            *
+ *----------------------------------------------------------------------*/
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifdef MAP_ANONYMOUS
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define REGION_ARENA_ALIGN (2*1024*1024)   /* huge page size on x86 */
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+/* Chunk states, apart from counts of free pages used by trim_freelist */
+#define RP_CHUNK_RELEASED  0xFFFF          /* returned to the OS */
+#define RP_CHUNK_RELEASING 0xFFFE          /* being returned to the OS */
+
+typedef struct rpArena {
+  char *base;                /* first chunk in the arena */
+  char *next;                /* next unused chunk */
+  char *end;                 /* end of the arena */
+  unsigned short *chunks;    /* chunk states, indexed by chunk number */
+  size_t released;           /* number of chunks returned to the OS */
+  int node;                  /* the node whose pool the arena serves */
+  struct rpArena *prev;      /* previously reserved arena */
+} RpArena;
+
+static RpArena *rp_arena = NULL;     /* the most recently reserved arena */
+static RpArena *rp_node_arena[REGION_NUMA_MAX_NODES];  /* the arenas currently carved from */
+
+#define chunk_index(a,p) ((size_t)((char *)(p) - (a)->base) / BYTES_ALLOC_BY_SBRK)
+#define chunk_base(a,i)  ((a)->base + (i) * BYTES_ALLOC_BY_SBRK)
+
+static void
+reserve_arena(int node)
+{
+  size_t size = ((size_t)region_arena_mb) << 20;
+  char *p, *q;
+  RpArena *a;
+
+  if ( size < BYTES_ALLOC_BY_SBRK )
+    return;
+  p = mmap(NULL, size + REGION_ARENA_ALIGN, PROT_READ | PROT_WRITE,
+	   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if ( p == MAP_FAILED ) {
+    region_arena_mb = 0;    /* do not try again; use malloc */
+    return;
+  }
+
+  /* trim the range to an aligned range of size bytes */
+  q = (char *)(((uintptr_t)p + REGION_ARENA_ALIGN - 1) & ~((uintptr_t)REGION_ARENA_ALIGN - 1));
+  if ( q > p )
+    munmap(p, q - p);
+  if ( p + REGION_ARENA_ALIGN > q )
+    munmap(q + size, p + REGION_ARENA_ALIGN - q);
+
+#ifdef MADV_HUGEPAGE
+  madvise(q, size, MADV_HUGEPAGE);
+#endif
+
+#if defined(THREADS) && defined(SYS_mbind)
+  if ( region_numa_nodes < 0 )
+    {
+      /* Prefer the node; the kernel ignores the last bit of the mask */
+      unsigned long mask = 1UL << node;
+      syscall(SYS_mbind, q, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+    }
+#endif
+
+  a = (RpArena *)malloc(sizeof(RpArena));
+  if ( a == NULL )
+    die("reserve_arena: unable to allocate arena descriptor");
+  a->chunks = (unsigned short *)calloc(size / BYTES_ALLOC_BY_SBRK, sizeof(unsigned short));
+  if ( a->chunks == NULL )
+    die("reserve_arena: unable to allocate chunk table");
+  a->base = a->next = q;
+  a->end = q + size;
+  a->released = 0;
+  a->node = node;
+  a->prev = rp_arena;
+  rp_arena = a;
+  rp_node_arena[node] = a;
+  return;
+}
+
+/* Return a chunk of BYTES_ALLOC_BY_SBRK bytes from the arenas of the
+ * node, or NULL if no arena space is available. */
+static char *
+arena_chunk(int node)
+{
+  RpArena *a;
+  size_t i;
+  char *p;
+
+  for ( a = rp_arena ; a ; a = a->prev )
+    if ( a->released && a->node == node )
+      {
+	for ( i = 0 ; a->chunks[i] != RP_CHUNK_RELEASED ; i++ )
+	  ;
+	a->chunks[i] = 0;
+	a->released--;
+	return chunk_base(a,i);
+      }
+
+  a = rp_node_arena[node];
+  if ( a == NULL || (size_t)(a->end - a->next) < BYTES_ALLOC_BY_SBRK )
+    {
+      reserve_arena(node);
+      a = rp_node_arena[node];
+    }
+  if ( a == NULL || (size_t)(a->end - a->next) < BYTES_ALLOC_BY_SBRK )
+    return NULL;
+  p = a->next;
+  a->next += BYTES_ALLOC_BY_SBRK;
+  return p;
+}
+
+static inline RpArena *
+arena_of(Rp *rp)
+{
+  RpArena *a;
+  for ( a = rp_arena ; a ; a = a->prev )
+    if ( (char *)rp >= a->base && (char *)rp < a->next )
+      return a;
+  return NULL;
+}
+
+/* Return whole free arena chunks to the operating system as long as
+ * more than region_keep_pages pages remain in the freelist pool (with
+ * GC, at least the free pages wanted by the heap-to-live ratio are
+ * kept). Called with FREELISTMUTEX held, after rp_trim_countdown pages
+ * have been inserted in the freelists; the countdown is set to at least
+ * the length of the pool so that the cost of the walks is amortised. */
+static void
+trim_freelist(Rp **pool)
+{
+  Rp *rp, **prev;
+  RpArena *a;
+  size_t n = 0, i, keep = (size_t)region_keep_pages;
+
+#ifdef ENABLE_GC
+  i = (size_t)((heap_to_live_ratio - 1.0) * (double)rp_used);
+  if ( i > keep )
+    keep = i;
+#endif /* ENABLE_GC */
+
+  /* The pool holds at most rp_free pages */
+  if ( rp_free < keep + REGION_PAGE_BAG_SIZE )
+    {
+      rp_trim_countdown = REGION_TRIM_INTERVAL;
+      return;
+    }
+
+  for ( rp = *pool ; rp ; rp = rp->n )
+    n++;
+  rp_trim_countdown = (n > REGION_TRIM_INTERVAL) ? n : REGION_TRIM_INTERVAL;
+
+  if ( n < keep + REGION_PAGE_BAG_SIZE )
+    return;
+
+  /* Count the free pages in each chunk */
+  for ( a = rp_arena ; a ; a = a->prev )
+    for ( i = 0 ; chunk_base(a,i) < a->next ; i++ )
+      if ( a->chunks[i] != RP_CHUNK_RELEASED )
+	a->chunks[i] = 0;
+  for ( rp = *pool ; rp ; rp = rp->n )
+    if ( (a = arena_of(rp)) )
+      a->chunks[chunk_index(a,rp)]++;
+
+  /* Select the chunks to release */
+  for ( a = rp_arena ; a ; a = a->prev )
+    for ( i = 0 ; chunk_base(a,i) < a->next && n >= keep + REGION_PAGE_BAG_SIZE ; i++ )
+      if ( a->chunks[i] == REGION_PAGE_BAG_SIZE )
+	{
+	  a->chunks[i] = RP_CHUNK_RELEASING;
+	  n -= REGION_PAGE_BAG_SIZE;
+	}
+
+  /* Unlink their pages from the pool */
+  prev = pool;
+  while ( (rp = *prev) )
+    {
+      a = arena_of(rp);
+      if ( a && a->chunks[chunk_index(a,rp)] == RP_CHUNK_RELEASING )
+	*prev = rp->n;
+      else
+	prev = &(rp->n);
+    }
+
+  rp_trim_countdown = (n > REGION_TRIM_INTERVAL) ? n : REGION_TRIM_INTERVAL;
+
+  /* and return them to the operating system */
+  for ( a = rp_arena ; a ; a = a->prev )
+    for ( i = 0 ; chunk_base(a,i) < a->next ; i++ )
+      if ( a->chunks[i] == RP_CHUNK_RELEASING )
+	{
+	  madvise(chunk_base(a,i), BYTES_ALLOC_BY_SBRK, MADV_DONTNEED);
+	  a->chunks[i] = RP_CHUNK_RELEASED;
+	  a->released++;
+	  rp_total -= REGION_PAGE_BAG_SIZE;
+	  rp_free -= REGION_PAGE_BAG_SIZE;
+	}
+  return;
+}
+#else
+static void
+trim_freelist(Rp **pool)
+{
+  rp_trim_countdown = REGION_TRIM_INTERVAL;
+  return;
+}
+#endif /* MAP_ANONYMOUS */
+
+/* Get a chunk of BYTES_ALLOC_BY_SBRK bytes, aligned to the size of a
+ * region page, from the arenas of the node or, failing that, from
+ * malloc. With -region_prefault, every page of the chunk is touched
+ * by the calling thread before the chunk is used. */
+static char *
+get_chunk(int node)
+{
+  static size_t os_page_size = 0;
+  char *sb = NULL, *p;
+  size_t temp;
+
+#ifdef MAP_ANONYMOUS
+  sb = arena_chunk(node);
+#endif /* MAP_ANONYMOUS */
+
+  if ( sb == NULL ) {
+    /* We must manually insure double alignment. Some operating systems (like *
+     * HP UX) does not return a double aligned address...                     */
+
+    /* For GC we require alignment to the size of a region page! */
+
+    sb = malloc(BYTES_ALLOC_BY_SBRK + sizeof(Rp));
+
+    if ( sb == NULL ) {
+      perror("I could not allocate more memory; either no more memory is\navailable or the memory subsystem is detectively corrupted\n");
+      exit(-1);
+    }
+
+    /* alignment (martin) */
+    if (( temp = (size_t)sb % sizeof(Rp) )) {
+      sb = sb + sizeof(Rp) - temp;
+    }
+  }
+
+  if ( region_prefault ) {
+    if ( os_page_size == 0 )
+      os_page_size = (size_t)sysconf(_SC_PAGESIZE);
+    for ( p = sb ; p < sb + BYTES_ALLOC_BY_SBRK ; p += os_page_size )
+      *(volatile char *)p = 0;
+  }
+  return sb;
+}
+
+/*----------------------------------------------------------------------*
+ * Large object blocks                                                  *
+ *                                                                      *
+ * Large objects are allocated in blocks of one or more units of        *
+ * REGION_PAGE_SIZE bytes, aligned to REGION_PAGE_SIZE, as required by  *
+ * the GC. Blocks of up to LOBJ_MAX_UNITS units are taken from size     *
+ * classes: there is a free list for each class, and an empty class is  *
+ * refilled by splitting a chunk obtained with get_chunk. The orig     *
+ * field of a block points to the descriptor of its chunk, which counts *
+ * the free blocks of the chunk. When all blocks of a chunk are free,   *
+ * the chunk is kept for reuse if the class has fewer than              *
+ * LOBJ_KEEP_EMPTY such chunks, and is otherwise returned to the        *
+ * operating system as trim_freelist returns chunks of free region      *
+ * pages, so that get_chunk hands it out again before carving new       *
+ * space. Chunks obtained with malloc are always kept. Larger blocks    *
+ * are allocated with malloc and freed with free. The free lists and    *
+ * the chunk descriptors are protected by FREELISTMUTEX.                *
+ *----------------------------------------------------------------------*/
+#define LOBJ_CLASSES 10
+#define LOBJ_NO_CLASS LOBJ_CLASSES
+#define LOBJ_MAX_UNITS 32
+#define LOBJ_KEEP_EMPTY 1    /* empty chunks kept in each class */
+
+#if REGION_PAGE_BAG_SIZE < LOBJ_MAX_UNITS
+#error "REGION_PAGE_BAG_SIZE must be at least LOBJ_MAX_UNITS"
 #endif
+
+static const size_t lobj_class_units[LOBJ_CLASSES] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+static Lobjs *lobj_freelist[LOBJ_CLASSES];
+static size_t lobj_empty[LOBJ_CLASSES];   /* chunks with all blocks free */
+
+typedef struct lobjChunk {
+  char *base;                /* the chunk, as returned by get_chunk */
+  size_t free;               /* number of free blocks in the chunk */
+} LobjChunk;
+
+#define lobj_chunk_blocks(c) (BYTES_ALLOC_BY_SBRK / (lobj_class_units[c] * REGION_PAGE_SIZE))
+
+/* Unlink the blocks of the chunk ch, which are all free, from the free
+ * list of class c and return the chunk to the operating system.
+ * Returns 0, and leaves the chunk alone, if it was not carved from an
+ * arena. Called with FREELISTMUTEX held. */
+static int
+lobj_chunk_release(size_t c, LobjChunk *ch)
+{
+#ifdef MAP_ANONYMOUS
+  Lobjs *lobjs, **prev = &lobj_freelist[c];
+  RpArena *a = arena_of((Rp *)ch->base);
+  size_t n = ch->free;
+
+  if ( a == NULL )
+    return 0;
+
+  while ( n && (lobjs = *prev) )
+    if ( lobjs->orig == ch )
+      {
+	*prev = lobjs->next;
+	n--;
+      }
+    else
+      prev = &(lobjs->next);
+
+  madvise(ch->base, BYTES_ALLOC_BY_SBRK, MADV_DONTNEED);
+  a->chunks[chunk_index(a,ch->base)] = RP_CHUNK_RELEASED;
+  a->released++;
+  free(ch);
+  return 1;
+#else
+  return 0;
+#endif /* MAP_ANONYMOUS */
+}
+
+static Lobjs *
+lobj_block_alloc(size_t sz_bytes)
+{
+  size_t units = (sz_bytes + REGION_PAGE_MASK) / REGION_PAGE_SIZE;
+  size_t c, i, k;
+  Lobjs *lobjs;
+  LobjChunk *ch;
+  char *p;
+
+  if ( units > LOBJ_MAX_UNITS )
+    {
+      p = malloc(sz_bytes + REGION_PAGE_SIZE);
+      if ( p == NULL )
+	die("alloc_lobjs: malloc returned NULL");
+      lobjs = (Lobjs *)(((uintptr_t)p + REGION_PAGE_MASK) & ~REGION_PAGE_MASK);
+      lobjs->orig = p;
+      lobjs->lclass = LOBJ_NO_CLASS;
+      lobjs->lsize = sz_bytes;
+      rs_counters()->lobjBytes += sz_bytes;
+      return lobjs;
+    }
+
+  for ( c = 0 ; lobj_class_units[c] < units ; c++ )
+    ;
+
+  LOCK_LOCK(FREELISTMUTEX);
+  if ( lobj_freelist[c] == NULL )
+    {
+      ch = (LobjChunk *)malloc(sizeof(LobjChunk));
+      if ( ch == NULL )
+	die("alloc_lobjs: malloc returned NULL");
+      ch->base = get_chunk(regionPageNode());
+      ch->free = 0;
+      k = lobj_class_units[c] * REGION_PAGE_SIZE;
+      for ( i = 0 ; i + k <= BYTES_ALLOC_BY_SBRK ; i += k )
+	{
+	  lobjs = (Lobjs *)(ch->base + i);
+	  lobjs->orig = ch;
+	  lobjs->next = lobj_freelist[c];
+	  lobj_freelist[c] = lobjs;
+	  ch->free++;
+	}
+      lobj_empty[c]++;
+    }
+  lobjs = lobj_freelist[c];
+  lobj_freelist[c] = lobjs->next;
+  ch = (LobjChunk *)lobjs->orig;
+  if ( ch->free-- == lobj_chunk_blocks(c) )
+    lobj_empty[c]--;
+  LOCK_UNLOCK(FREELISTMUTEX);
+
+  lobjs->lclass = c;
+  lobjs->lsize = lobj_class_units[c] * REGION_PAGE_SIZE;
+  rs_counters()->lobjBytes += lobjs->lsize;
   return lobjs;
 }
 
+/* Called with FREELISTMUTEX held */
+static inline void
+lobj_block_free(Lobjs *lobjs)
+{
+  size_t c = lobjs->lclass;
+  LobjChunk *ch;
+
+  rs_counters()->lobjBytes -= lobjs->lsize;
+  if ( c == LOBJ_NO_CLASS )
+    {
+      free(lobjs->orig);
+      return;
+    }
+  lobjs->next = lobj_freelist[c];
+  lobj_freelist[c] = lobjs;
+  ch = (LobjChunk *)lobjs->orig;
+  // an empty chunk is kept unless the class already has enough
+  // empty chunks and the chunk can be released
+  if ( ++ch->free == lobj_chunk_blocks(c)
+       && ( lobj_empty[c] < LOBJ_KEEP_EMPTY || ! lobj_chunk_release(c, ch) ) )
+    lobj_empty[c]++;
+  return;
+}
+
+void
+free_lobj(Lobjs *lobjs)
+{
+  LOCK_LOCK(FREELISTMUTEX);
+  lobj_block_free(lobjs);
+  LOCK_UNLOCK(FREELISTMUTEX);
+  return;
+}
+
 /*----------------------------------------------------------------------*
  *callSbrk:                                                             *
  *  Sbrk is called and the free list is updated.                        *
  *  The free list has to be empty.                                      *
+ *fill_pool:                                                            *
+ *  As callSbrk, but for the pool of a node.                            *
  *----------------------------------------------------------------------*/
 void callSbrk() { 
+  fill_pool(&freelist, 0);
+}
+
+static void
+fill_pool(Rp **pool, int node)
+{
   Rp *np, *old_free_list;
   char *sb;
-  size_t temp;
 
 #ifdef PROFILING
   callsOfSbrk++;
 #endif
 
-  /* We must manually insure double alignment. Some operating systems (like *
-   * HP UX) does not return a double aligned address...                     */
-
-  /* For GC we require 1Kb alignments, that is the size of a region page! */
-
-  sb = malloc(BYTES_ALLOC_BY_SBRK + 1024 /*8*/);
-
-  if ( sb == NULL ) {
-    perror("I could not allocate more memory; either no more memory is\navailable or the memory subsystem is detectively corrupted\n");
-    exit(-1);
-  }
-
-  /* alignment (martin) */
-  if (( temp = (size_t)sb % 1024 )) {
-    sb = sb + 1024 - temp;
-  }
+  sb = get_chunk(node);
 
   if ( ! is_rp_aligned((size_t)sb) )
     die("SBRK region page is not properly aligned.");
 
-  old_free_list = freelist;
+  old_free_list = *pool;
   np = (Rp *) sb;
-  freelist = np;
+  *pool = np;
 
   rp_total++;
+  rp_free++;
 
   /* fragment the SBRK-chunk into region pages */
-  while ((void *)(np+1) < ((void *)freelist)+BYTES_ALLOC_BY_SBRK) { 
+  while ((void *)(np+1) < ((void *)sb)+BYTES_ALLOC_BY_SBRK) { 
     np++;
     (np-1)->n = np;
     rp_total++;
+    rp_free++;
   }
   np->n = old_free_list;
 
   #ifdef ENABLE_GC
-  if (!disable_gc)
-    time_to_gc = 1;
+  if ( !disable_gc && !time_to_gc )
+    {
+      time_to_gc = 1;
+      gc_trigger = GC_TRIGGER_EXTEND;
+    }
   #endif /* ENABLE_GC */
 
   return;
@@ -748,10 +1630,11 @@ void callSbrk() {
  *  is space for the n words before doing the allocation.               *
  *  Objects whose size n <= ALLOCATABLE_WORDS_IN_REGION_PAGE are        *
  *  allocated in region pages; larger objects are allocated using       *
- *  malloc.                                                             *
+ *  malloc. The common case is handled by allocGenInline in Region.h;   *
+ *  allocGenSlow is only called when that fast path fails.              *
  *----------------------------------------------------------------------*/
-inline uintptr_t *
-allocGen (Gen *gen, size_t n) { 
+__attribute__((noinline)) uintptr_t *
+allocGenSlow (Gen *gen, size_t n) { 
   uintptr_t *t1;
   uintptr_t *t2;
   uintptr_t *t3;
@@ -761,7 +1644,7 @@ allocGen (Gen *gen, size_t n) {
   uintptr_t *i;
 #endif
 
-  debug(printf("[allocGen... generation: %p", gen));
+  debug(printf("[allocGenSlow... generation: %p", gen));
 
 #ifdef PROFILING
   r = get_ro_from_gen(*gen);
@@ -790,15 +1673,21 @@ allocGen (Gen *gen, size_t n) {
       //fprintf(stderr,"Allocated large object of %d words (address: %p) ; header at %p\n", n, &(lobjs->value), lobjs);
       lobjs->next = set_lobj_bit(r->lobjs);
       r->lobjs = lobjs;
+#ifdef ENABLE_GEN_GC
+      // the object is initialised without card marking, and may
+      // therefore point into the young generations (see GC.c)
+      *card_of(lobjs) = 1;
+#endif /* ENABLE_GEN_GC */
     #ifdef PROFILING
       allocatedLobjs++;
     #endif
 #ifdef ENABLE_GC
-      lobjs_current += 4*n;
-      lobjs_period += 4*n;
-      if ( (!disable_gc) && (lobjs_current>lobjs_gc_treshold) ) 
+      lobjs_current += n*sizeof(uintptr_t);
+      lobjs_period += n*sizeof(uintptr_t);
+      if ( (!disable_gc) && (!time_to_gc) && (lobjs_current>lobjs_gc_treshold) ) 
 	{
 	  time_to_gc = 1;
+	  gc_trigger = GC_TRIGGER_LOBJS;
 	}
 #endif
       // set the constant bit so that GC won't run 
@@ -809,7 +1698,7 @@ allocGen (Gen *gen, size_t n) {
     }
 
 #ifdef ENABLE_GC
-  alloc_period += 4*n;
+  alloc_period += (sizeof(void *))*n;
 #endif
 
   t1 = gen->a;
@@ -833,8 +1722,12 @@ allocGen (Gen *gen, size_t n) {
   return t1;
 }
 
+uintptr_t *allocGen (Gen *gen, size_t n) {
+  return allocGenInline(gen,n);
+}
+
 uintptr_t *alloc (Region r, size_t n) {
-  return allocGen(&(clearStatusBits(r)->g0),n);
+  return allocInline(r,n);
 }
 
 /*----------------------------------------------------------------------*
@@ -854,10 +1747,7 @@ void resetGen(Gen *gen)
                             //   concerning conservative computation.
 #endif /* ENABLE_GC */  
 
-    LOCK_LOCK(FREELISTMUTEX);
-    (((Rp *)(gen->b))-1)->n = freelist;
-    freelist = (clear_fp(gen->fp))->n;
-    LOCK_UNLOCK(FREELISTMUTEX);
+    free_page_chain((clear_fp(gen->fp))->n, ((Rp *)(gen->b))-1);
     (clear_fp(gen->fp))->n = NULL;
   }
 
@@ -882,6 +1772,7 @@ resetRegion(Region rAdr)
   debug(printf("[resetRegions..."));
 
   r = clearStatusBits(rAdr);
+  rs_counters()->regionResets++;
 
 #ifdef PROFILING
   callsOfResetRegion++;
@@ -940,6 +1831,7 @@ deallocateRegionsUntil(Region r
     }
 #endif
 
+#ifdef PROFILING
   while (r <= TOP_REGION) 
     { 
       /*printf("r: %0x, top region %0x\n",r,TOP_REGION);*/
@@ -949,6 +1841,17 @@ deallocateRegionsUntil(Region r
 #endif
 		      );
     }
+#else
+  {
+    Ro *stop;
+    for ( stop = TOP_REGION ; stop && r <= stop ; stop = stop->p ) ;
+    deallocateRegionsBatch(stop
+#ifdef KAM
+			   , topRegionCell
+#endif
+			   );
+  }
+#endif /* PROFILING */
 
   debug(printf("]\n"));
 
@@ -978,11 +1881,19 @@ deallocateRegionsUntil_X86(Region r)
     }
 #endif
 
+#ifdef PROFILING
   while (r >= TOP_REGION) 
     {
       /*printf("r: %0x, top region %0x\n",r,TOP_REGION);*/
       deallocateRegion();
     }
+#else
+  {
+    Ro *stop;
+    for ( stop = TOP_REGION ; stop && r >= stop ; stop = stop->p ) ;
+    deallocateRegionsBatch(stop);
+  }
+#endif /* PROFILING */
 
   debug(printf("]\n"));
 
@@ -1025,6 +1936,7 @@ allocRegionInfiniteProfiling(Region r, size_t regionId)
   regionDescUseProfInf += sizeRoProf;
   maxRegionDescUseProfInf = max(maxRegionDescUseProfInf,regionDescUseProfInf);
 
+  rs_counters()->regionAllocs++;
   r->p = TOP_REGION;	         // Push this region onto the region stack
   r->allocNow = 0;               // No allocation yet
   r->allocProfNow = 0;           // No allocation yet
@@ -1278,10 +2190,85 @@ free_region_pages(Rp* first, Rp* last)
 {
   if ( first == 0 )
     return;
+  free_page_chain(first, last);
+  return;
+}
+#endif /*KAM*/
+
+#ifdef ENABLE_GC
+/* Insert from-space, the chain first..last of n region pages, in the
+ * freelist; called by the garbage collector, which knows n. */
+void
+free_from_space(Rp *first, Rp *last, size_t n)
+{
   LOCK_LOCK(FREELISTMUTEX);
   last->n = freelist;
   freelist = first;
+  rp_free += n;
   LOCK_UNLOCK(FREELISTMUTEX);
   return;
 }
-#endif /*KAM*/
+#endif /* ENABLE_GC */
+
+/*----------------------------------------------------------------------*
+ *regionStats:                                                          *
+ *  Sum the region statistics counters of all threads.                  *
+ *printRegionStats:                                                     *
+ *  Print the statistics on stderr (on exit, with -region_stats).       *
+ *sml_regionstats:                                                      *
+ *  Return the statistics as an ML record (see basis/RegionStats.sml);  *
+ *  the fields are in alphabetical order.                               *
+ *----------------------------------------------------------------------*/
+void
+regionStats(RegionStats *s)
+{
+  RsCounters *c;
+
+  s->lobjBytes = 0;
+  s->regionAllocs = s->regionDeallocs = s->regionResets = 0;
+  for ( c = rs_all ; c ; c = c->next )
+    {
+      s->lobjBytes += c->lobjBytes;
+      s->regionAllocs += c->regionAllocs;
+      s->regionDeallocs += c->regionDeallocs;
+      s->regionResets += c->regionResets;
+    }
+  LOCK_LOCK(FREELISTMUTEX);
+  s->pagesInUse = rp_out();
+  s->pagesHighWater = rp_out_max;
+  s->pagesTotal = rp_total;
+  LOCK_UNLOCK(FREELISTMUTEX);
+  return;
+}
+
+void
+printRegionStats(void)
+{
+  RegionStats s;
+  regionStats(&s);
+  fprintf(stderr, "\nRegion statistics:\n");
+  fprintf(stderr, "  Region pages in use:         %zu (high-water %zu, total %zu)\n",
+	  s.pagesInUse, s.pagesHighWater, s.pagesTotal);
+  fprintf(stderr, "  Region page size:            %d bytes\n", (int)REGION_PAGE_SIZE);
+  fprintf(stderr, "  Large object bytes:          %ld\n", s.lobjBytes);
+  fprintf(stderr, "  Regions allocated:           %zu\n", s.regionAllocs);
+  fprintf(stderr, "  Regions deallocated:         %zu\n", s.regionDeallocs);
+  fprintf(stderr, "  Regions reset:               %zu\n", s.regionResets);
+  return;
+}
+
+uintptr_t
+sml_regionstats(uintptr_t vAddr)
+{
+  RegionStats s;
+  regionStats(&s);
+  mkTagRecordML(vAddr,7);
+  elemRecordML(vAddr,0) = convertIntToML(s.lobjBytes);
+  elemRecordML(vAddr,1) = convertIntToML(s.pagesHighWater);
+  elemRecordML(vAddr,2) = convertIntToML(s.pagesInUse);
+  elemRecordML(vAddr,3) = convertIntToML(s.pagesTotal);
+  elemRecordML(vAddr,4) = convertIntToML(s.regionAllocs);
+  elemRecordML(vAddr,5) = convertIntToML(s.regionDeallocs);
+  elemRecordML(vAddr,6) = convertIntToML(s.regionResets);
+  return vAddr;
+}
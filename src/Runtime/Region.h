@@ -5,6 +5,7 @@
 #define REGION_H
 
 #include <stdint.h>
+#include "../config.h"
 #include "Flags.h"
  
 /*
@@ -55,39 +56,40 @@ words in all.
 
 */
 
-// Uncomment the following line to enable region page statistics (for SMLserver)
-//#define REGION_PAGE_STAT 1
-#ifdef REGION_PAGE_STAT
-typedef struct regionPageMapHashList {
-  unsigned long n;                               /* reuse number */
-  uintptr_t addr;                            /* address of region page */
-  struct regionPageMapHashList * next; /* next hashed element */
-} RegionPageMapHashList;
+/* 
+ * Size of a region page in bytes. The size must be a power of two;
+ * it is set with the configure option --with-region-page-size
+ * (1K, 4K, 16K, or 64K). By default, a region page is 256 words.
+ * Region pages are aligned to their size, which is used by GC to
+ * find the page of an object (see REGION_PAGE_MASK).
+ */
 
-typedef RegionPageMapHashList* RegionPageMap;
+#ifndef REGION_PAGE_SIZE
+#if defined(__LP64__) || (__WORDSIZE == 64)
+#define REGION_PAGE_SIZE 2048
+#else
+#define REGION_PAGE_SIZE 1024
+#endif
+#endif /* REGION_PAGE_SIZE */
 
-/* Size of region page map hash table in entries -- (2^n-1) */
-#define REGION_PAGE_MAP_HASH_TABLE_SIZE 511
-#define hashRegionPageIndex(addr) ((addr) % REGION_PAGE_MAP_HASH_TABLE_SIZE)
-RegionPageMap* regionPageMapNew(void);
-extern RegionPageMap* rpMap;
-#endif /* REGION_PAGE_STAT */
+#define REGION_PAGE_MASK ((uintptr_t)REGION_PAGE_SIZE - 1)
+#define pages_to_kb(n)   ((n) * (REGION_PAGE_SIZE / 1024))
 
 /* 
  * Number of words that can be allocated in each regionpage and number
  * of words in the header part of each region page.
  *
  * ALLOCATABLE_WORDS_IN_REGION_PAGE + HEADER_WORDS_IN_REGION_PAGE must
- * be one 1Kb - used by GC.
+ * be REGION_PAGE_SIZE bytes - used by GC.
  */
 
 #ifdef ENABLE_GEN_GC
-#define ALLOCATABLE_WORDS_IN_REGION_PAGE 253
 #define HEADER_WORDS_IN_REGION_PAGE 3
 #else
-#define ALLOCATABLE_WORDS_IN_REGION_PAGE 254
 #define HEADER_WORDS_IN_REGION_PAGE 2 
 #endif /* ENABLE_GEN_GC */
+#define ALLOCATABLE_WORDS_IN_REGION_PAGE \
+  (REGION_PAGE_SIZE / sizeof(uintptr_t) - HEADER_WORDS_IN_REGION_PAGE)
 
 typedef struct rp {
   struct rp *n;                   /* NULL or pointer to next page. */
@@ -98,11 +100,7 @@ typedef struct rp {
   uintptr_t i[ALLOCATABLE_WORDS_IN_REGION_PAGE];  /* space for data*/
 } Rp;
 
-#if defined(__LP64__) || (__WORDSIZE == 64)
-#define is_rp_aligned(rp)  (((rp) & 0x7FF) == 0)
-#else
-#define is_rp_aligned(rp)  (((rp) & 0x3FF) == 0)
-#endif
+#define is_rp_aligned(rp)  (((rp) & REGION_PAGE_MASK) == 0)
 
 /* Free pages are kept in a free list. When the free list becomes
  * empty and more space is required, the runtime system calls the
@@ -110,7 +108,7 @@ typedef struct rp {
  * (here 30) of fresh region pages: */
 
 /* Size of allocated space in each SBRK-call. */
-#define BYTES_ALLOC_BY_SBRK REGION_PAGE_BAG_SIZE*sizeof(Rp)  
+#define BYTES_ALLOC_BY_SBRK (REGION_PAGE_BAG_SIZE*sizeof(Rp))
 
 /* When garbage collection is enabled, a single bit in a region page
  * descriptor specifies if the page is part of to-space during garbage
@@ -144,17 +142,20 @@ typedef struct rp {
  * index parameter.  -- mael 2001-09-13 */
 
 /* For tag-free garbage collection of pairs, triples, and refs, we
- * make sure that large objects are aligned on 1K boundaries, which
- * makes it possible to determine if a pointer points into the stack,
- * constants in data space, a region in from-space, or a region in
- * to-space. The orig pointer points back to the memory allocated by
- * malloc (which holds the large object). */
+ * make sure that large objects are aligned on region page boundaries,
+ * which makes it possible to determine if a pointer points into the
+ * stack, constants in data space, a region in from-space, or a region
+ * in to-space. Large objects are allocated in size classes of blocks
+ * owned by the runtime system (see Region.c), and the orig pointer
+ * points to the descriptor of the chunk holding the block; for
+ * objects too large for any class, the orig pointer points back to
+ * the memory allocated by malloc (which holds the large object). */
 
 typedef struct lobjs {
   struct lobjs* next;     // pointer to next large object or NULL
-#ifdef ENABLE_GC
-  void* orig;             // pointer to memory allocated by malloc - for freeing
-#endif
+  void* orig;             // memory allocated by malloc, or chunk of the block - for freeing
+  size_t lclass;          // size class of the block holding the object
+  size_t lsize;           // size of the block holding the object, in bytes
 #ifdef KAM
   size_t sizeOfLobj;      // size of this object
 #endif
@@ -258,6 +259,8 @@ typedef Ro* Region;
 //     010    (hex 0x2)   arrays   (value is tagged, but the region type 
 //                                  is needed by generational collector)
 //     011    (hex 0x3)   refs
+//     100    (hex 0x4)   strings  (value is tagged, but contains no
+//                                  pointers; see allocateStringRegion)
 //     111    (hex 0x7)   triples
 
 // To make Generational GC possible we use two more bits to encode 
@@ -284,6 +287,7 @@ typedef Ro* Region;
 #define RTYPE_PAIR          0x1
 #define RTYPE_ARRAY         0x2
 #define RTYPE_REF           0x3
+#define RTYPE_STRING        0x4
 #define RTYPE_TRIPLE        0x7
 #define GENERATION_STATUS   0x8
 #define GENERATION          0x10
@@ -297,11 +301,13 @@ typedef Ro* Region;
 #define is_arrayregion(gen)  (rtype(gen) == RTYPE_ARRAY)
 #define is_refregion(gen)    (rtype(gen) == RTYPE_REF)
 #define is_tripleregion(gen) (rtype(gen) == RTYPE_TRIPLE)
+#define is_stringregion(gen) (rtype(gen) == RTYPE_STRING)
 #define set_fp(gen,rt)       ((gen).fp = (Rp*)(((uintptr_t)((gen).fp)) | (rt)))
 #define set_pairregion(gen)  (set_fp((gen),RTYPE_PAIR))
 #define set_arrayregion(gen) (set_fp((gen),RTYPE_ARRAY))
 #define set_refregion(gen)   (set_fp((gen),RTYPE_REF))
 #define set_tripleregion(gen) (set_fp((gen),RTYPE_TRIPLE))
+#define set_stringregion(gen) (set_fp((gen),RTYPE_STRING))
 #define set_gen_status_SOME(gen) (set_fp((gen),GENERATION_STATUS))
 #define set_gen_status_NONE(gen) ((gen).fp = (Rp*)(((uintptr_t)((gen).fp)) & (UINTPTR_MAX ^ 0x8)))
 // #define set_gen_status_NONE(gen) ((gen).fp = (Rp*)(((unsigned long)((gen).fp)) & 0xFFFFFFF7))
@@ -321,6 +327,24 @@ typedef Ro* Region;
 #define get_ro_from_gen(gen)    ( (Ro*)(((uintptr_t)(&(gen)))-offsetG0InRo) )
 #endif /* ENABLE_GEN_GC */
 
+#ifdef ENABLE_GEN_GC
+/* Card marking. A store of a value into a ref or an array (by code
+ * generated by CodeGenX86.sml) sets the byte in gc_card_table that
+ * covers the address of the ref or the array. A minor collection
+ * then scans only the refs and arrays in old generations (g1) that
+ * lie on a page with a marked card (see GC.c). A card is no larger
+ * than a region page; CARD_SHIFT must agree with the value in
+ * CodeGenX86.sml. On 32-bit machines, the table covers the entire
+ * address space; on 64-bit machines, addresses share entries, which
+ * is safe as the collector only consults the cards of its own pages
+ * and at worst scans a page that is not dirty. */
+#define CARD_SHIFT        9
+#define CARD_TABLE_SIZE   ((size_t)1 << (32 - CARD_SHIFT))
+#define CARDS_IN_REGION_PAGE (REGION_PAGE_SIZE >> CARD_SHIFT)
+#define card_of(p)        (&gc_card_table[((uintptr_t)(p) >> CARD_SHIFT) & (CARD_TABLE_SIZE - 1)])
+extern unsigned char gc_card_table[];
+#endif /* ENABLE_GEN_GC */
+
 /*
 Region polymorphism
 -------------------
@@ -383,18 +407,74 @@ void deallocateRegionsUntil_X86(Region rAddr);
 
 uintptr_t *alloc (Region r, size_t n);
 uintptr_t *allocGen (Gen *gen, size_t n);
+uintptr_t *allocGenSlow (Gen *gen, size_t n);
 void alloc_new_block(Gen *gen);
 void callSbrk();
+void flushRegionPageCache(void);  /* return pages cached by the calling thread */
+int regionPageNode(void);         /* the page pool (NUMA node) of the calling thread */
+
+/*----------------------------------------------------------------*
+ * Region statistics, kept in all builds (see Region.c). Print    *
+ * them on exit with -region_stats; from ML, use RegionStats.get. *
+ *----------------------------------------------------------------*/
+typedef struct regionStats {
+  long lobjBytes;           /* bytes in blocks holding large objects */
+  size_t pagesHighWater;    /* maximal number of region pages in use */
+  size_t pagesInUse;        /* region pages not in a free list */
+  size_t pagesTotal;        /* region pages obtained from the OS */
+  size_t regionAllocs;      /* infinite regions allocated */
+  size_t regionDeallocs;    /* infinite regions deallocated */
+  size_t regionResets;      /* infinite regions reset */
+} RegionStats;
+
+void regionStats(RegionStats *s);
+void printRegionStats(void);
+void regionPageStatInit(long n);   /* see -region_page_stat */
+void printRegionPageStats(void);
+uintptr_t sml_regionstats(uintptr_t vAddr);
+#ifdef ENABLE_GC
+void free_from_space(Rp *first, Rp *last, size_t n);
+#endif
 
 #ifdef ENABLE_GC_OLD
 void callSbrkArg(size_t no_of_region_pages);
 #endif
 
+/*----------------------------------------------------------------------*
+ * allocGenInline, allocInline:                                         *
+ *  Fast path of allocGen and alloc. If the object fits in the current  *
+ *  region page of the generation, it is allocated by bumping the       *
+ *  allocation pointer; otherwise allocGenSlow (in Region.c) takes care *
+ *  of large objects and of getting a new region page. When profiling,  *
+ *  every allocation goes through allocGenSlow.                         *
+ *----------------------------------------------------------------------*/
+#ifdef ENABLE_GC
+extern size_t alloc_period;
+#endif
+
+static inline uintptr_t *
+allocGenInline (Gen *gen, size_t n) {
+#ifndef PROFILING
+  uintptr_t *t = gen->a;
+  if ( (size_t)(gen->b - t) >= n ) {
+    gen->a = t + n;
+#ifdef ENABLE_GC
+    alloc_period += (sizeof(void *))*n;
+#endif
+    return t;
+  }
+#endif
+  return allocGenSlow(gen, n);
+}
+
+#define allocInline(r,n) (allocGenInline(&(clearStatusBits(r)->g0),(n)))
+
 #ifdef ENABLE_GC
 Region allocatePairRegion(Region roAddr);
 Region allocateArrayRegion(Region roAddr);
 Region allocateRefRegion(Region roAddr);
 Region allocateTripleRegion(Region roAddr);
+Region allocateStringRegion(Region roAddr);
 #ifdef PROFILING
 Region allocPairRegionInfiniteProfiling(Region r, size_t regionId);
 Region allocPairRegionInfiniteProfilingMaybeUnTag(Region r, size_t regionId);
@@ -515,6 +595,7 @@ void pp_gen(Gen *gen);
 void chk_obj_in_gen(Gen *gen, uintptr_t *obj_ptr, char* s);
 
 void free_lobjs(Lobjs* lobjs);
+void free_lobj(Lobjs* lobjs);
 
 void RegionLocksInit(void);
 
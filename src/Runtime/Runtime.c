@@ -84,7 +84,7 @@ terminateML (long status)
 
 #ifdef ENABLE_GC
   extern ssize_t gc_total;
-  extern ssize_t rp_total;
+  extern long rp_total;
   extern size_t alloc_total;
   extern size_t alloc_period;
   extern double FRAG_sum;
@@ -96,6 +96,11 @@ terminateML (long status)
   Statistics();        
 #endif
 
+  if ( region_stats )
+    printRegionStats();
+  if ( region_page_stat )
+    printRegionPageStats();
+
 #ifdef ENABLE_GC
   if ( report_gc || verbose_gc )
     { 
@@ -104,7 +109,7 @@ terminateML (long status)
 #ifdef ENABLE_GEN_GC
       fprintf(stderr, " (%zd major)", num_gc_major);
 #endif
-      fprintf(stderr, ", %zdkb rpages", rp_total);
+      fprintf(stderr, ", %zdkb rpages", (ssize_t)pages_to_kb(rp_total));
     }
 
   if ( report_gc )
@@ -124,6 +129,9 @@ terminateML (long status)
 	      ri, gc, FRAG_sum / (double)(num_gc-1));
       fflush(stderr);
     }
+
+  if ( report_gc || verbose_gc )
+    report_gc_pauses();
 #endif /* ENABLE_GC */
 
   debug(printf("]\n"));
@@ -181,6 +189,11 @@ uncaught_exception (String exnStr, unsigned long n, uintptr_t ep)
   Statistics();        
 #endif
 
+  if ( region_stats )
+    printRegionStats();
+  if ( region_page_stat )
+    printRegionPageStats();
+
   exit (-1); 
 }
 
@@ -337,9 +350,8 @@ main(int argc, char *argv[])
 
   parseCmdLineArgs(argc, argv);   /* also initializes ml-access to args */
 
-#ifdef REGION_PAGE_STAT
-rpMap = regionPageMapNew();
-#endif /* REGION_PAGE_STAT */
+  if ( region_page_stat )
+    regionPageStatInit(region_page_stat);
 
 #ifdef PROFILING
   resetProfiler();
@@ -351,7 +363,16 @@ rpMap = regionPageMapNew();
 
   debug(printf("Starting execution...\n");)
 #ifdef KAM
-  return (main_interp(argc, argv));
+  {
+    /* the KAM implements terminateML by halting the interpreter,
+     * so the statistics are printed here */
+    ssize_t res = main_interp(argc, argv);
+    if ( region_stats )
+      printRegionStats();
+    if ( region_page_stat )
+      printRegionPageStats();
+    return res;
+  }
 #else
   code();
   return (EXIT_FAILURE);   /* never comes here (i.e., exits through 
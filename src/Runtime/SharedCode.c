@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "Flags.h"
+#include "SharedCode.h"
+
+/*
+ * Loaded leaf bytecode shared among the child processes of SMLserver
+ */
+
+// The arena file holds a header followed by code. Both are written
+// only with pwrite, while holding a lock on the file that excludes
+// other processes (the caller holds CODECACHEMUTEX, which excludes
+// the other threads of the process); the processes read them through
+// their read-only mapping, which shows what is written to the file.
+// Code is never removed from the arena; when the arena is full, code
+// is no longer shared.
+
+typedef struct sharedCodeEntry {
+  SharedCodeId id;
+  uintptr_t offset;             // offset of the code in the arena
+} SharedCodeEntry;
+
+typedef struct sharedCodeHeader {
+  uintptr_t used;               // bytes in use, including the header
+  uintptr_t entries;            // number of entries in use
+  SharedCodeEntry entry[SHARED_CODE_ENTRIES];
+} SharedCodeHeader;
+
+static int arena_fd = -1;
+static SharedCodeHeader *arena = NULL;
+static size_t arena_size = 0;
+
+// fcntl locks are held by processes, so that the lock excludes the
+// children, which share the file descriptor of the parent
+static void
+arena_lock(short type)
+{
+  struct flock fl;
+
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 1;
+  while ( fcntl(arena_fd, F_SETLKW, &fl) < 0 && errno == EINTR )
+    ;
+}
+
+static int
+arena_write(size_t offset, const void *buf, size_t n)
+{
+  ssize_t k;
+
+  for ( ; n > 0 ; n -= k, offset += k, buf = (const char *)buf + k )
+    if ( (k = pwrite(arena_fd, buf, n, offset)) <= 0 )
+      {
+	if ( k < 0 && errno == EINTR )
+	  k = 0;
+	else
+	  return -1;
+      }
+  return 0;
+}
+
+static void
+arena_close(void)
+{
+  if ( arena )
+    munmap((void *)arena, arena_size);
+  if ( arena_fd >= 0 )
+    close(arena_fd);
+  arena = NULL;
+  arena_fd = -1;
+  arena_size = 0;
+}
+
+int
+sharedCodeInit(size_t mb)
+{
+  char name[] = "/tmp/mlkit-code-XXXXXX";
+  uintptr_t used = sizeof(SharedCodeHeader);
+  void *p;
+
+  arena_close();
+  if ( mb == 0 || mb * 1024 * 1024 <= sizeof(SharedCodeHeader) )
+    return -1;
+  if ( (arena_fd = mkstemp(name)) < 0 )
+    return -1;
+  unlink(name);     // the file lives as long as a process has it open
+  arena_size = mb * 1024 * 1024;
+  if ( ftruncate(arena_fd, arena_size) < 0
+       || (p = mmap(NULL, arena_size, PROT_READ, MAP_SHARED, arena_fd, 0)) == MAP_FAILED )
+    {
+      arena_close();
+      return -1;
+    }
+  arena = (SharedCodeHeader *)p;
+  if ( arena_write(offsetof(SharedCodeHeader, used), &used, sizeof(used)) < 0 )
+    {
+      arena_close();
+      return -1;
+    }
+  return 0;
+}
+
+int
+sharedCodeMakeId(const char *file, uintptr_t key, SharedCodeId *id)
+{
+  struct stat st;
+  time_t now;
+
+  if ( arena == NULL || stat(file, &st) < 0 )
+    return -1;
+  // a file that is replaced again within the resolution of the time
+  // stamps may keep its identity; such a file is shared only once it
+  // has not changed for a while
+  now = time(NULL);
+  if ( now - st.st_mtime < SHARED_CODE_MIN_AGE
+       || now - st.st_ctime < SHARED_CODE_MIN_AGE )
+    return -1;
+  id->dev = (uintptr_t)st.st_dev;
+  id->ino = (uintptr_t)st.st_ino;
+  id->size = (uintptr_t)st.st_size;
+  id->mtime = (uintptr_t)st.st_mtim.tv_sec;
+  id->mtime_nsec = (uintptr_t)st.st_mtim.tv_nsec;
+  id->ctime = (uintptr_t)st.st_ctim.tv_sec;
+  id->ctime_nsec = (uintptr_t)st.st_ctim.tv_nsec;
+  id->key = key;
+  return 0;
+}
+
+// the caller holds the lock on the arena
+static bytecode_t
+find(SharedCodeId *id)
+{
+  uintptr_t i;
+
+  for ( i = 0 ; i < arena->entries ; i++ )
+    if ( memcmp(&(arena->entry[i].id), id, sizeof(SharedCodeId)) == 0 )
+      return (bytecode_t)arena + arena->entry[i].offset;
+  return NULL;
+}
+
+bytecode_t
+sharedCodeLookup(SharedCodeId *id)
+{
+  bytecode_t code;
+
+  if ( arena == NULL )
+    return NULL;
+  arena_lock(F_RDLCK);
+  code = find(id);
+  arena_lock(F_UNLCK);
+  return code;
+}
+
+bytecode_t
+sharedCodeInsert(SharedCodeId *id, bytecode_t code, size_t sizeW)
+{
+  SharedCodeEntry e;
+  uintptr_t header[2];
+  size_t n = sizeW * sizeof(uintptr_t);
+  bytecode_t res;
+
+  if ( arena == NULL )
+    return NULL;
+  arena_lock(F_WRLCK);
+  if ( (res = find(id)) == NULL
+       && arena->entries < SHARED_CODE_ENTRIES
+       && n <= arena_size - arena->used )
+    {
+      e.id = *id;
+      e.offset = arena->used;
+      header[0] = arena->used + n;
+      header[1] = arena->entries + 1;
+      // the header is written last, so that the entry is complete
+      // when it becomes visible
+      if ( arena_write(e.offset, code, n) == 0
+	   && arena_write(offsetof(SharedCodeHeader, entry)
+			  + arena->entries * sizeof(SharedCodeEntry),
+			  &e, sizeof(e)) == 0
+	   && arena_write(offsetof(SharedCodeHeader, used),
+			  header, sizeof(header)) == 0 )
+	res = (bytecode_t)arena + e.offset;
+    }
+  arena_lock(F_UNLCK);
+  return res;
+}
+
+int
+sharedCodeOwns(bytecode_t code)
+{
+  return arena != NULL
+    && code >= (bytecode_t)arena
+    && code < (bytecode_t)arena + arena_size;
+}
@@ -0,0 +1,62 @@
+#ifndef SHARED_CODE_H
+#define SHARED_CODE_H
+
+/*
+ * Loaded leaf bytecode shared among the child processes of SMLserver
+ */
+
+#include <stdint.h>
+#include "LoadKAM.h"
+
+// The arena is a file that the parent process maps read-only before
+// the children are forked, so that the arena is at the same address
+// in all children. A child that loads and resolves a bytecode file
+// writes the resolved code into the arena file (see
+// sharedCodeInsert); the code then shows up in the mapping of every
+// process, which can run it without loading the file. Resolved code
+// holds instruction addresses and offsets to the code of the
+// libraries, which are valid only in processes that have the same
+// interpreter and library code as the process that resolved the
+// code; the key of an entry identifies both (see extendLibraryKey
+// in LoadKAM.c, which builds interp->libraryKey).
+
+typedef struct sharedCodeId {
+  uintptr_t dev;     // device, inode, size, and modification and
+  uintptr_t ino;     //   status change times of the bytecode file
+  uintptr_t size;
+  uintptr_t mtime;
+  uintptr_t mtime_nsec;
+  uintptr_t ctime;
+  uintptr_t ctime_nsec;
+  uintptr_t key;     // identity of interpreter and libraries
+} SharedCodeId;
+
+// [sharedCodeInit(mb)] creates an arena of mb Mb, replacing an arena
+// created earlier by the process. Must be called by the parent
+// process before children are forked. If mb is 0 or the arena cannot
+// be created, the arena is disabled. Returns 0 on success and -1 if
+// the arena is disabled.
+int sharedCodeInit(size_t mb);
+
+// [sharedCodeMakeId(file,key,id)] fills in id for the bytecode file
+// file. Returns 0 on success and -1 if the arena is disabled, if the
+// file cannot be stat'ed, or if the file was changed less than
+// SHARED_CODE_MIN_AGE seconds ago (see Flags.h), in which case the
+// file must not be shared.
+int sharedCodeMakeId(const char *file, uintptr_t key, SharedCodeId *id);
+
+// [sharedCodeLookup(id)] returns the code in the arena with the
+// identity id, or NULL if there is no such code.
+bytecode_t sharedCodeLookup(SharedCodeId *id);
+
+// [sharedCodeInsert(id,code,sizeW)] copies the resolved code code of
+// sizeW words into the arena and returns the copy, or NULL if the
+// arena is full. If another process has inserted code with the
+// identity id in the meantime, that code is returned.
+bytecode_t sharedCodeInsert(SharedCodeId *id, bytecode_t code, size_t sizeW);
+
+// [sharedCodeOwns(code)] returns 1 if code is in the arena (and thus
+// must not be freed) and 0 otherwise.
+int sharedCodeOwns(bytecode_t code);
+
+#endif /* SHARED_CODE_H */
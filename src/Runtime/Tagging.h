@@ -10,7 +10,7 @@
 #define tag_kind(x)                 ((x) & 0x1F)         /* Least 5 significant bits    */
 #define val_tag(x)                  (*(uintptr_t *)x)
 #define val_tag_kind(x)             ((*(uintptr_t *)x) & 0x1F) /* Least 5 significant bits    */
-#define is_const(x)                 (((unsigned long)x) & 0x20)  /* Bit 6 is the constant bit   */
+#define is_const(x)                 (((uintptr_t)x) & 0x20)  /* Bit 6 is the constant bit   */
 #define set_tag_const(x)            ((x) | 0x20)         /* Set bit 6, the constant bit */
 #define clear_tag_const(x)          ((x) & (UINTPTR_MAX ^ 0x20))   /* Clear bit 6                 */
 // #define clear_tag_const(x)          ((x) & 0xFFFFFFDF)   /* Clear bit 6                 */
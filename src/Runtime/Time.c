@@ -96,7 +96,7 @@ sml_mktime (uintptr_t vAddr, uintptr_t v)
 }
 
 String
-REG_POLY_FUN_HDR(sml_asctime, Region rAddr, uintptr_t v, int exn) 
+REG_POLY_FUN_HDR(sml_asctime, Region rAddr, uintptr_t v, uintptr_t exn) 
 {
   struct tm tmr;
   char *r;
@@ -119,7 +119,7 @@ REG_POLY_FUN_HDR(sml_asctime, Region rAddr, uintptr_t v, int exn)
 }
 
 String
-REG_POLY_FUN_HDR(sml_strftime, Region rAddr, String fmt, uintptr_t v, int exn) 
+REG_POLY_FUN_HDR(sml_strftime, Region rAddr, String fmt, uintptr_t v, uintptr_t exn) 
 {
   struct tm tmr;
   int ressize;
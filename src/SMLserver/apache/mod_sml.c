@@ -15,6 +15,8 @@
 #include "parseul.h"
 #include "sched.h"
 #include "../../Runtime/HeapCache.h"
+#include "../../Runtime/SharedCode.h"
+#include "../../Runtime/CommandLine.h"
 #include "greeting.h"
 
 #ifdef APLOG_USE_MODULE
@@ -196,6 +198,43 @@ set_auxdata(cmd_parms *cmd, void *mconfig, const char *aux)/*{{{*/
   return NULL;
 }/*}}}*/
 
+static const char *
+set_region_page_stat (cmd_parms * cmd, void *mconfig, const char *n) /*{{{ */
+{
+  region_page_stat = atol (n);
+  if (region_page_stat < 0)
+    return "SmlRegionPageStat: the sampling interval must not be negative";
+  return NULL;
+}       /*}}} */
+
+static const char *
+set_region_numa (cmd_parms * cmd, void *mconfig, int flag) /*{{{ */
+{
+  region_numa_nodes = flag ? -1 : 0;
+  return NULL;
+}       /*}}} */
+
+static const char *
+set_region_numa_sim (cmd_parms * cmd, void *mconfig, const char *n) /*{{{ */
+{
+  region_numa_nodes = atol (n);
+  if (region_numa_nodes < 1 || region_numa_nodes > REGION_NUMA_MAX_NODES)
+    return "SmlRegionNumaSim: the number of nodes is out of range";
+  return NULL;
+}       /*}}} */
+
+// size (in Mb) of the arena for leaf bytecode shared among children
+static long shared_code_mb = SHARED_CODE_MB;
+
+static const char *
+set_code_cache_size (cmd_parms * cmd, void *mconfig, const char *n) /*{{{ */
+{
+  shared_code_mb = atol (n);
+  if (shared_code_mb < 0)
+    return "SmlCodeCacheSize: the size must not be negative";
+  return NULL;
+}       /*}}} */
+
 static const 
 command_rec mod_sml_cmds[] = /*{{{ */
 {
@@ -211,6 +250,14 @@ command_rec mod_sml_cmds[] = /*{{{ */
     "SMLSYNTAX ERR SmlExtendedTyping"),
   AP_INIT_TAKE1 ("SmlAuxData", set_auxdata, NULL, RSRC_CONF,
       "SMLSYNTAX ERR SmlAuxData"),
+  AP_INIT_TAKE1 ("SmlRegionPageStat", set_region_page_stat, NULL, RSRC_CONF,
+      "SMLSYNTAX ERR SmlRegionPageStat"),
+  AP_INIT_TAKE1 ("SmlCodeCacheSize", set_code_cache_size, NULL, RSRC_CONF,
+      "SMLSYNTAX ERR SmlCodeCacheSize"),
+  AP_INIT_FLAG ("SmlRegionNuma", set_region_numa, NULL, RSRC_CONF,
+      "SMLSYNTAX ERR SmlRegionNuma"),
+  AP_INIT_TAKE1 ("SmlRegionNumaSim", set_region_numa_sim, NULL, RSRC_CONF,
+      "SMLSYNTAX ERR SmlRegionNumaSim"),
   {NULL}
 };        /*}}} */
 
@@ -265,6 +312,8 @@ apr_status_t
 shutdownChild (void *ctx1)/*{{{*/
 {
   InterpContext *ctx = (InterpContext *) ctx1;
+  if (region_page_stat)
+    printRegionPageStats ();
   interpClear(ctx->interp);
   clearHeapCache ();
   clearSmlMap (ctx->smlTable);
@@ -337,9 +386,8 @@ apsml_post_config (apr_pool_t * pconf, apr_pool_t * plog, apr_pool_t * ptemp, se
   rd->ctx->smlTable = NULL;
   apr_pool_cleanup_register(pconf, rd->ctx, shutdownServer, shutdownChild);
 
-#ifdef REGION_PAGE_STAT
-  rpMap = regionPageMapNew ();
-#endif /* REGION_PAGE_STAT */
+  if (region_page_stat)
+    regionPageStatInit (region_page_stat);
 
   // initialize stackPool Mutex, freelist Mutex, and codeCache Mutex
   for( i=0 ; i<4 ; i++ )
@@ -352,6 +400,15 @@ apsml_post_config (apr_pool_t * pconf, apr_pool_t * plog, apr_pool_t * ptemp, se
 
   resolveGlobalCodeFragments ();
 
+  // the arena must be mapped before the children are forked, so that
+  // it is at the same address in all children
+  if (sharedCodeInit (shared_code_mb) == 0)
+    ap_log_error (APLOG_MARK, LOG_DEBUG, 0, s,
+                  "apsml: sharing %ld Mb of loaded code among children", shared_code_mb);
+  else if (shared_code_mb)
+    ap_log_error (APLOG_MARK, LOG_WARNING, 0, s,
+                  "apsml: unable to create the arena for shared code");
+
   ctx->interp = interpNew ();
 
   rd->pool = pconf;
@@ -706,7 +763,7 @@ apsml_processSmlFile (request_data * rd, char *uri, int kind) //{{{
   char *key;
   const char *file;
   struct parseCtx pCtx;
-  int res;
+  ssize_t res;
   time_t t;
   Serverstate ss;
   char *errorStr = NULL;
@@ -94,6 +94,7 @@ kitmolgard.sml          tx tc
 msort.mlb               tx tc 
 tststrcmp.sml                 
 FuhMishra.mlb           tx tc 
+regionpages.sml         tx    
 
 (* Tests of dynamic semantics and the Basis Library *)
 
@@ -145,6 +146,8 @@ pickletest.mlb
 packreal.sml                  
 patricia.sml                  
 stream.mlb                    
+regionstats.mlb               
+cint.sml                      
 natset.sml                    
 fns.sml                       
 datatypes.sml                 